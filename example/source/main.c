@@ -4,11 +4,10 @@
 #define MAX_SPRITES 2048
 
 typedef struct {
-    float x, y;
+    pp2d_sprite_s sprite;
     float dx, dy;
     float angle;
     u32 color;
-    size_t id;
 } sprite_t;
 
 static bool blending = false;
@@ -17,22 +16,14 @@ static bool moving = false;
 static size_t n = 256;
 static sprite_t sprites[MAX_SPRITES];
 
-void simpleSpritesheetHandler(size_t i)
+void applySpriteSettings(void)
 {
-    // select the portion of the spritesheet that needs to be rendered
-    pp2d_texture_select_part(0, sprites[i].x, sprites[i].y, (sprites[i].id / 2)*32, (sprites[i].id % 2)*32, 32, 32);
-    if (blending)
-    {
-        // set a blending color
-        pp2d_texture_blend(sprites[i].color);
-    }
-    if (rotating)
+    for (size_t i = 0; i < MAX_SPRITES; i++)
     {
-        // rotate a texture of a desiderd angle
-        pp2d_texture_rotate(sprites[i].angle);
+        // pp2d reads the blending color and the angle straight from our sprites
+        sprites[i].sprite.color = blending ? sprites[i].color : PP2D_DEFAULT_COLOR_NEUTRAL;
+        sprites[i].sprite.angle = rotating ? sprites[i].angle : 0;
     }
-    // add the selected texture with all its data to pp2d's queue
-    pp2d_texture_queue();
 }
 
 void initSprites(void)
@@ -40,35 +31,45 @@ void initSprites(void)
     srand(time(NULL));
     for (size_t i = 0; i < MAX_SPRITES; i++)
     {
-        sprites[i].x = rand() % (PP2D_SCREEN_TOP_WIDTH - 32);
-        sprites[i].y = rand() % (PP2D_SCREEN_HEIGHT - 32);
+        size_t id = rand() & 3;
+        // select the portion of the spritesheet that needs to be rendered
+        sprites[i].sprite.x = rand() % (PP2D_SCREEN_TOP_WIDTH - 32);
+        sprites[i].sprite.y = rand() % (PP2D_SCREEN_HEIGHT - 32);
+        sprites[i].sprite.xbegin = (id / 2)*32;
+        sprites[i].sprite.ybegin = (id % 2)*32;
+        sprites[i].sprite.width = 32;
+        sprites[i].sprite.height = 32;
         sprites[i].dx = rand()*4.0f/RAND_MAX - 2.0f;
         sprites[i].dy = rand()*4.0f/RAND_MAX - 2.0f;
         sprites[i].angle = rand() % 360;
         sprites[i].color = RGBA8(rand() % 0xFF, rand() % 0xFF,rand() % 0xFF,rand() % 0xFF);
-        sprites[i].id = rand() & 3;
     }
+    applySpriteSettings();
 }
 
 void updateSprites(void)
 {
     for (size_t i = 0; i < n; i++)
     {
-        sprites[i].x += sprites[i].dx;
-        sprites[i].y += sprites[i].dy;
+        sprites[i].sprite.x += sprites[i].dx;
+        sprites[i].sprite.y += sprites[i].dy;
 
         //check for collision with the screen boundaries
-        if ((sprites[i].x < 1) || (sprites[i].x > PP2D_SCREEN_TOP_WIDTH - 32))
+        if ((sprites[i].sprite.x < 1) || (sprites[i].sprite.x > PP2D_SCREEN_TOP_WIDTH - 32))
         {
             sprites[i].dx = -sprites[i].dx;
         }
 
-        if ((sprites[i].y < 1) || (sprites[i].y > PP2D_SCREEN_HEIGHT - 32))
+        if ((sprites[i].sprite.y < 1) || (sprites[i].sprite.y > PP2D_SCREEN_HEIGHT - 32))
         {
             sprites[i].dy = -sprites[i].dy;
         }
 
         sprites[i].angle++;
+        if (rotating)
+        {
+            sprites[i].sprite.angle = sprites[i].angle;
+        }
     }
 }
 
@@ -99,8 +100,8 @@ int main()
         if ((hidKeysHeld() & KEY_UP) && n < MAX_SPRITES) n++;
         else if ((hidKeysHeld() & KEY_DOWN) && n > 1) n--;
         
-        if (hidKeysDown() & KEY_TOUCH && touch.px >= 20 && touch.px <= 100 && touch.py >= 160 && touch.py <= 210) blending = !blending;
-        else if (hidKeysDown() & KEY_TOUCH && touch.px >= 120 && touch.px <= 200 && touch.py >= 160 && touch.py <= 210) rotating = !rotating;
+        if (hidKeysDown() & KEY_TOUCH && touch.px >= 20 && touch.px <= 100 && touch.py >= 160 && touch.py <= 210) { blending = !blending; applySpriteSettings(); }
+        else if (hidKeysDown() & KEY_TOUCH && touch.px >= 120 && touch.px <= 200 && touch.py >= 160 && touch.py <= 210) { rotating = !rotating; applySpriteSettings(); }
         else if (hidKeysDown() & KEY_TOUCH && touch.px >= 220 && touch.px <= 300 && touch.py >= 160 && touch.py <= 210) moving = !moving;
         
         if (moving)
@@ -110,11 +111,8 @@ int main()
 
         //begin a frame. this needs to be called once per frame, not once per screen
         pp2d_frame_begin(GFX_TOP, GFX_LEFT);
-            // draw our sprites
-            for (size_t i = 0; i < n; i++)
-            {
-                simpleSpritesheetHandler(i);
-            }
+            // draw our sprites, pp2d reads them straight from the array
+            pp2d_texture_queue_batch(0, &sprites[0].sprite, n, sizeof(sprite_t));
 
         // change screen
         pp2d_frame_draw_on(GFX_BOTTOM, GFX_LEFT);
@@ -0,0 +1,264 @@
+/*  This file is part of pp2d
+>   Copyright (C) 2017/2018 Bernardo Giordano
+>
+>   This program is free software: you can redistribute it and/or modify
+>   it under the terms of the GNU General Public License as published by
+>   the Free Software Foundation, either version 3 of the License, or
+>   (at your option) any later version.
+>
+>   This program is distributed in the hope that it will be useful,
+>   but WITHOUT ANY WARRANTY; without even the implied warranty of
+>   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+>   GNU General Public License for more details.
+>
+>   You should have received a copy of the GNU General Public License
+>   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+>   See LICENSE for information.
+>
+>   https://discord.gg/bGKEyfY
+*/
+
+/**
+ * Plug & Play 2D
+ * @file instancing.c
+ * @brief instanced sprites compared with quads and geometry shader sprites
+ */
+
+#include <time.h>
+#include "pp2d.h"
+#include "c3d_trace.h"
+
+#define SPRITES 4096
+#define ROUNDS 200
+// sprites per draw call of the instance shader
+#define INSTANCES 22
+// largest differences tolerated between the quads written by the CPU and the ones built by the shaders
+#define MAX_POSITION_ERROR 0.1
+#define MAX_TEXCOORD_ERROR 0.001
+
+// layout of the points pp2d writes for the geometry shader
+typedef struct {
+    float x, y, z, angle;
+    float halfWidth, halfHeight;
+    float left, top, right, bottom;
+    u32 color;
+} sprite_point_t;
+
+typedef enum {
+    MODE_QUADS,
+    MODE_GEOMETRY,
+    MODE_INSTANCED
+} sprite_mode_t;
+
+static const char* modeNames[] = { "quads", "geometry", "instanced" };
+
+static pp2d_sprite_s sprites[SPRITES];
+
+static double now_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec*1e6 + ts.tv_nsec/1e3;
+}
+
+static void init_sprites(void)
+{
+    srand(0x3D5);
+    for (size_t i = 0; i < SPRITES; i++)
+    {
+        sprites[i].x = rand() % (PP2D_SCREEN_TOP_WIDTH - 32);
+        sprites[i].y = rand() % (PP2D_SCREEN_HEIGHT - 32);
+        sprites[i].angle = (i % 3) ? rand()*360.0f/RAND_MAX : 0;
+        sprites[i].color = RGBA8(rand() & 0xFF, rand() & 0xFF, rand() & 0xFF, 0xFF);
+        sprites[i].xbegin = (i % 4)*32;
+        sprites[i].ybegin = (i % 7)*32;
+        sprites[i].width = 8 + (i % 5)*6;
+        sprites[i].height = 8 + (i % 3)*10;
+    }
+}
+
+static void set_mode(sprite_mode_t mode)
+{
+    pp2d_set_geometry_sprites(mode == MODE_GEOMETRY);
+    pp2d_set_instanced_sprites(mode == MODE_INSTANCED);
+}
+
+static void draw_frame(size_t count)
+{
+    pp2d_frame_begin(GFX_TOP, GFX_LEFT);
+        pp2d_texture_queue_batch(0, sprites, count, 0);
+    pp2d_frame_end();
+}
+
+static float vertex_value(s16 compact, float value, float one)
+{
+#if PP2D_COMPACT_VERTICES
+    (void)value;
+    return compact / one;
+#else
+    (void)compact;
+    (void)one;
+    return value;
+#endif
+}
+
+static void sprite_sincos(float turns, float* s, float* c)
+{
+    // the parabola approximation of sprite.g.pica, applied to t and t + 0.25 turns
+    float values[2] = { turns, turns + 0.25f };
+    for (int i = 0; i < 2; i++)
+    {
+        const float wrapped = values[i] - floorf(values[i] + 0.5f);
+        const float u = wrapped + wrapped;
+        const float p = 4*u*(1 - fabsf(u));
+        values[i] = p + 0.225f*(p*fabsf(p) - p);
+    }
+    *s = values[0];
+    *c = values[1];
+}
+
+static const vertex_s* capture_frame(sprite_mode_t mode, size_t* size, u32* draws)
+{
+    set_mode(mode);
+    c3d_trace_capture(true);
+    c3d_trace_reset();
+    draw_frame(INSTANCES);
+    c3d_trace_capture(false);
+    *draws = c3d_trace_stats()->counts[TRACE_DRAW_ELEMENTS] + c3d_trace_stats()->counts[TRACE_DRAW_ARRAYS];
+    return (const vertex_s*)c3d_trace_vertices(size);
+}
+
+static void compare_corner(const vertex_s* vtx, float x, float y, float u, float v, double* positionError, double* texcoordError)
+{
+    const double dx = x - vertex_value(vtx->x, vtx->x, 16.0f);
+    const double dy = y - vertex_value(vtx->y, vtx->y, 16.0f);
+    const double du = u - vertex_value(vtx->u, vtx->u, 32767.0f);
+    const double dv = v - vertex_value(vtx->v, vtx->v, 32767.0f);
+    const double position = sqrt(dx*dx + dy*dy);
+    const double texcoord = fmax(fabs(du), fabs(dv));
+    *positionError = position > *positionError ? position : *positionError;
+    *texcoordError = texcoord > *texcoordError ? texcoord : *texcoordError;
+}
+
+static bool report(const char* mode, u32 draws, u32 expectedDraws, double positionError, double texcoordError, int colorErrors)
+{
+    const bool match = draws == expectedDraws && positionError <= MAX_POSITION_ERROR && texcoordError <= MAX_TEXCOORD_ERROR && colorErrors == 0;
+    printf("%-10s %d sprites in %u draw call(s), max error vs quads: %.5f px, %.6f texcoord, %d colors: %s\n",
+        mode, INSTANCES, draws, positionError, texcoordError, colorErrors, match ? "ok" : "MISMATCH");
+    return match;
+}
+
+static bool check_accuracy(void)
+{
+    // reference vertices, written by the CPU
+    size_t size;
+    u32 draws;
+    const vertex_s* vertices = capture_frame(MODE_QUADS, &size, &draws);
+    if (size < INSTANCES*PP2D_QUAD_VERTICES*sizeof(vertex_s))
+    {
+        printf("missing vertices: %zu bytes\n", size);
+        return false;
+    }
+    vertex_s* reference = malloc(size);
+    memcpy(reference, vertices, size);
+
+    static const int corners[4][2] = { {0, 0}, {0, 1}, {1, 0}, {1, 1} };
+#if PP2D_INDEXED_QUADS
+    static const int slots[4] = { 0, 1, 2, 3 };
+#else
+    static const int slots[4] = { 0, 1, 2, 5 };
+#endif
+
+    // run the geometry shader on the points it was given
+    const sprite_point_t* points = (const sprite_point_t*)capture_frame(MODE_GEOMETRY, &size, &draws);
+    double positionError = size < INSTANCES*sizeof(sprite_point_t) ? INFINITY : 0, texcoordError = 0;
+    int colorErrors = 0;
+    for (size_t i = 0; positionError != INFINITY && i < INSTANCES; i++)
+    {
+        float s, c;
+        sprite_sincos(points[i].angle, &s, &c);
+        for (int k = 0; k < 4; k++)
+        {
+            const float sx = corners[k][0]*2 - 1, sy = corners[k][1]*2 - 1;
+            const float x = points[i].x + sx*c*points[i].halfWidth - sy*s*points[i].halfHeight;
+            const float y = points[i].y + sx*s*points[i].halfWidth + sy*c*points[i].halfHeight;
+            const float u = corners[k][0] ? points[i].right : points[i].left;
+            const float v = corners[k][1] ? points[i].bottom : points[i].top;
+            compare_corner(&reference[i*PP2D_QUAD_VERTICES + slots[k]], x, y, u, v, &positionError, &texcoordError);
+        }
+        colorErrors += points[i].color != reference[i*PP2D_QUAD_VERTICES].color;
+    }
+    bool match = report(modeNames[MODE_GEOMETRY], draws, 1, positionError, texcoordError, colorErrors);
+
+    capture_frame(MODE_INSTANCED, &size, &draws);
+
+    // run the instance shader on the uniforms it was given
+    const C3D_FVec* center = c3d_trace_uniform(GPU_VERTEX_SHADER, shaderInstanceGetUniformLocation(NULL, "center"));
+    const C3D_FVec* axis = c3d_trace_uniform(GPU_VERTEX_SHADER, shaderInstanceGetUniformLocation(NULL, "axis"));
+    const C3D_FVec* texrect = c3d_trace_uniform(GPU_VERTEX_SHADER, shaderInstanceGetUniformLocation(NULL, "texrect"));
+    const C3D_FVec* tint = c3d_trace_uniform(GPU_VERTEX_SHADER, shaderInstanceGetUniformLocation(NULL, "tint"));
+
+    positionError = 0;
+    texcoordError = 0;
+    colorErrors = 0;
+    for (size_t i = 0; i < INSTANCES; i++)
+    {
+        for (int k = 0; k < 4; k++)
+        {
+            const float s = corners[k][0]*2 - 1, t = corners[k][1]*2 - 1;
+            const float x = center[i].x + s*center[i].z + t*axis[i].x;
+            const float y = center[i].y + s*center[i].w + t*axis[i].y;
+            const float u = texrect[i].x + corners[k][0]*texrect[i].z;
+            const float v = texrect[i].y + corners[k][1]*texrect[i].w;
+            compare_corner(&reference[i*PP2D_QUAD_VERTICES + slots[k]], x, y, u, v, &positionError, &texcoordError);
+        }
+
+        const u32 color = RGBA8((int)lroundf(tint[i].x*255), (int)lroundf(tint[i].y*255), (int)lroundf(tint[i].z*255), (int)lroundf(tint[i].w*255));
+        colorErrors += color != reference[i*PP2D_QUAD_VERTICES].color;
+    }
+    free(reference);
+
+    match = report(modeNames[MODE_INSTANCED], draws, 1, positionError, texcoordError, colorErrors) && match;
+    return match;
+}
+
+static void measure(sprite_mode_t mode)
+{
+    set_mode(mode);
+    c3d_trace_reset();
+
+    const double start = now_us();
+    for (int round = 0; round < ROUNDS; round++)
+    {
+        draw_frame(SPRITES);
+    }
+    const double ns = (now_us() - start) * 1000 / ((double)ROUNDS * SPRITES);
+
+    const trace_stats_t* stats = c3d_trace_stats();
+    const double frames = stats->frames ? stats->frames : 1;
+    const u32 draws = stats->counts[TRACE_DRAW_ELEMENTS] + stats->counts[TRACE_DRAW_ARRAYS];
+    printf("%-10s %8.1f %8.1f %10.1f %10.1f %10.2f\n", modeNames[mode], draws / frames,
+        stats->counts[TRACE_UNIFORM] / frames, stats->uniformVectors*16 / frames / 1024, stats->vertexBytes / frames / 1024, ns);
+}
+
+int main(void)
+{
+    pp2d_init();
+
+    u32* sheet = linearAlloc(256*256*4);
+    memset(sheet, 0xFF, 256*256*4);
+    pp2d_load_texture_memory(0, sheet, 256, 256, GX_TRANSFER_FMT_RGBA8);
+    linearFree(sheet);
+
+    init_sprites();
+    const bool accurate = check_accuracy();
+
+    printf("%d sprites per frame\n", SPRITES);
+    printf("%-10s %8s %8s %10s %10s %10s\n", "mode", "draws", "unifs", "unif KB", "vtx KB", "ns/sprite");
+    measure(MODE_QUADS);
+    measure(MODE_GEOMETRY);
+    measure(MODE_INSTANCED);
+
+    pp2d_exit();
+    return accurate ? 0 : 1;
+}
@@ -0,0 +1,240 @@
+/*  This file is part of pp2d
+>   Copyright (C) 2017/2018 Bernardo Giordano
+>
+>   This program is free software: you can redistribute it and/or modify
+>   it under the terms of the GNU General Public License as published by
+>   the Free Software Foundation, either version 3 of the License, or
+>   (at your option) any later version.
+>
+>   This program is distributed in the hope that it will be useful,
+>   but WITHOUT ANY WARRANTY; without even the implied warranty of
+>   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+>   GNU General Public License for more details.
+>
+>   You should have received a copy of the GNU General Public License
+>   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+>   See LICENSE for information.
+>
+>   https://discord.gg/bGKEyfY
+*/
+
+/**
+ * Plug & Play 2D
+ * @file particles.c
+ * @brief particles moved by the caller and queued one by one compared with particle emitters
+ */
+
+#include <time.h>
+#include "pp2d.h"
+#include "c3d_trace.h"
+
+#define PARTICLES 8192
+#define FRAMES 300
+#define STEP (1.0f/60)
+
+typedef enum {
+    MODE_QUEUED,
+    MODE_EMITTER
+} particle_mode_t;
+
+static const char* modeNames[] = { "queued", "emitter" };
+
+static const pp2d_emitter_s fountain = {
+    .x = 200, .y = 200, .spreadX = 40, .spreadY = 4,
+    .velocityX = 0, .velocityY = -150, .velocitySpread = 60,
+    .accelerationX = 0, .accelerationY = 120,
+    .lifetime = 1.5f, .lifetimeSpread = 0.5f,
+    .startSize = 8, .endSize = 2,
+    .startColor = RGBA8(255, 240, 128, 255), .endColor = RGBA8(255, 32, 0, 0),
+    .xbegin = 0, .ybegin = 0, .width = 16, .height = 16
+};
+
+// what a game does without emitters: an array of particle records, each one queued through the texture state
+static struct {
+    float x, y;
+    float velocityX, velocityY;
+    float age, aging;
+} particles[PARTICLES];
+static size_t particleCount;
+
+static double now_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec*1e6 + ts.tv_nsec/1e3;
+}
+
+static float random_spread(void)
+{
+    return rand()*(2.0f/RAND_MAX) - 1.0f;
+}
+
+static u8 fade_channel(u32 start, u32 end, int shift, float age)
+{
+    const float from = (start >> shift) & 0xFF;
+    const float to = (end >> shift) & 0xFF;
+    return (u8)(from + (to - from)*age);
+}
+
+static void update_queued(void)
+{
+    for (size_t i = 0; i < particleCount; )
+    {
+        particles[i].velocityX += fountain.accelerationX*STEP;
+        particles[i].velocityY += fountain.accelerationY*STEP;
+        particles[i].x += particles[i].velocityX*STEP;
+        particles[i].y += particles[i].velocityY*STEP;
+        particles[i].age += particles[i].aging*STEP;
+        if (particles[i].age >= 1.0f)
+        {
+            particles[i] = particles[--particleCount];
+            continue;
+        }
+        i++;
+    }
+
+    for (; particleCount < PARTICLES; particleCount++)
+    {
+        particles[particleCount].x = fountain.x + fountain.spreadX*random_spread();
+        particles[particleCount].y = fountain.y + fountain.spreadY*random_spread();
+        particles[particleCount].velocityX = fountain.velocityX + fountain.velocitySpread*random_spread();
+        particles[particleCount].velocityY = fountain.velocityY + fountain.velocitySpread*random_spread();
+        particles[particleCount].age = 0;
+        particles[particleCount].aging = 1.0f/(fountain.lifetime + fountain.lifetimeSpread*random_spread());
+    }
+}
+
+static void draw_queued(void)
+{
+    for (size_t i = 0; i < particleCount; i++)
+    {
+        const float age = particles[i].age;
+        const float size = fountain.startSize + (fountain.endSize - fountain.startSize)*age;
+        pp2d_texture_select_part(0, particles[i].x - size/2, particles[i].y - size/2, fountain.xbegin, fountain.ybegin, fountain.width, fountain.height);
+        pp2d_texture_scale(size/fountain.width, size/fountain.height);
+        pp2d_texture_blend(RGBA8(fade_channel(fountain.startColor, fountain.endColor, 0, age), fade_channel(fountain.startColor, fountain.endColor, 8, age),
+            fade_channel(fountain.startColor, fountain.endColor, 16, age), fade_channel(fountain.startColor, fountain.endColor, 24, age)));
+        pp2d_texture_queue();
+    }
+}
+
+static bool check_accuracy(void)
+{
+    // particles that don't move or spread are the same square as a sprite queued there, in the color of their age
+    pp2d_emitter_s still = fountain;
+    still.spreadX = still.spreadY = still.velocitySpread = still.lifetimeSpread = 0;
+    still.velocityX = still.velocityY = still.accelerationX = still.accelerationY = 0;
+    still.startSize = still.endSize = 16;
+    pp2d_emitter_create(1, 0, 64, &still);
+    pp2d_emitter_emit(1, 64);
+    pp2d_emitter_update(1, still.lifetime/2);
+    const u32 color = RGBA8(255, 136, 64, 127);
+
+    c3d_trace_capture(true);
+    c3d_trace_reset();
+    pp2d_frame_begin(GFX_TOP, GFX_LEFT);
+        pp2d_texture_select_part(0, still.x - 8, still.y - 8, still.xbegin, still.ybegin, still.width, still.height);
+        pp2d_texture_blend(color);
+        pp2d_texture_queue();
+        pp2d_emitter_draw(1);
+    pp2d_frame_end();
+    c3d_trace_capture(false);
+    const u32 draws = c3d_trace_stats()->counts[TRACE_DRAW_ELEMENTS] + c3d_trace_stats()->counts[TRACE_DRAW_ARRAYS];
+
+    size_t size;
+    const vertex_s* vertices = (const vertex_s*)c3d_trace_vertices(&size);
+    int mismatches = size != 65*PP2D_QUAD_VERTICES*sizeof(vertex_s);
+    for (size_t i = 1; !mismatches && i < 65; i++)
+    {
+        mismatches += memcmp(&vertices[i*PP2D_QUAD_VERTICES], vertices, PP2D_QUAD_VERTICES*sizeof(vertex_s)) != 0;
+    }
+    // the sprite and the particles share their state, so they go in one draw
+    const bool match = mismatches == 0 && draws == 1 && pp2d_emitter_get_count(1) == 64;
+    printf("64 particles at half their lifetime vs a queued sprite: %d mismatches, %u draw call(s), %zu left: %s\n",
+        mismatches, draws, pp2d_emitter_get_count(1), match ? "ok" : "MISMATCH");
+    pp2d_emitter_free(1);
+    return match;
+}
+
+static void run_frames(particle_mode_t mode)
+{
+    for (int frame = 0; frame < FRAMES; frame++)
+    {
+        if (mode == MODE_QUEUED)
+        {
+            update_queued();
+        }
+        else
+        {
+            pp2d_emitter_update(0, STEP);
+            pp2d_emitter_emit(0, PARTICLES);
+        }
+
+        pp2d_frame_begin(GFX_TOP, GFX_LEFT);
+            if (mode == MODE_QUEUED)
+            {
+                draw_queued();
+            }
+            else
+            {
+                pp2d_emitter_draw(0);
+            }
+        pp2d_frame_end();
+    }
+}
+
+static double measure_frame_cost(void)
+{
+    // beginning and ending a frame that draws something, display transfers included
+    const double start = now_us();
+    for (int frame = 0; frame < FRAMES; frame++)
+    {
+        pp2d_frame_begin(GFX_TOP, GFX_LEFT);
+            pp2d_texture_select_part(0, 0, 0, 0, 0, 16, 16);
+            pp2d_texture_queue();
+        pp2d_frame_end();
+    }
+    return (now_us() - start) / FRAMES;
+}
+
+static void measure(particle_mode_t mode, double frameCost)
+{
+    // a first round fills the fountain and warms the caches, the second one is timed
+    run_frames(mode);
+    c3d_trace_reset();
+
+    const double start = now_us();
+    run_frames(mode);
+    const double elapsed = (now_us() - start) / FRAMES - frameCost;
+
+    const trace_stats_t* stats = c3d_trace_stats();
+    printf("%-8s %8.1f %10.1f %10.1f %14.0f\n", modeNames[mode],
+        (double)(stats->counts[TRACE_DRAW_ELEMENTS] + stats->counts[TRACE_DRAW_ARRAYS]) / FRAMES,
+        (double)stats->vertexBytes / FRAMES / 1024,
+        elapsed,
+        PARTICLES / (elapsed / 1000));
+}
+
+int main(void)
+{
+    pp2d_init();
+
+    u32* sheet = linearAlloc(64*64*4);
+    memset(sheet, 0xFF, 64*64*4);
+    pp2d_load_texture_memory(0, sheet, 64, 64, GX_TRANSFER_FMT_RGBA8);
+    linearFree(sheet);
+
+    const bool accurate = check_accuracy();
+
+    srand(0x3D5);
+    pp2d_emitter_create(0, 0, PARTICLES, &fountain);
+
+    printf("%d particles moved, faded and drawn every frame, CPU time beyond a frame drawing a single sprite\n", PARTICLES);
+    const double frameCost = measure_frame_cost();
+    printf("%-8s %8s %10s %10s %14s\n", "mode", "draws", "vtx KB", "us/frame", "particles/ms");
+    measure(MODE_QUEUED, frameCost);
+    measure(MODE_EMITTER, frameCost);
+
+    pp2d_exit();
+    return accurate ? 0 : 1;
+}
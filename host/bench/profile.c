@@ -0,0 +1,503 @@
+/*  This file is part of pp2d
+>   Copyright (C) 2017/2018 Bernardo Giordano
+>
+>   This program is free software: you can redistribute it and/or modify
+>   it under the terms of the GNU General Public License as published by
+>   the Free Software Foundation, either version 3 of the License, or
+>   (at your option) any later version.
+>
+>   This program is distributed in the hope that it will be useful,
+>   but WITHOUT ANY WARRANTY; without even the implied warranty of
+>   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+>   GNU General Public License for more details.
+>
+>   You should have received a copy of the GNU General Public License
+>   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+>   See LICENSE for information.
+>
+>   https://discord.gg/bGKEyfY
+*/
+
+/**
+ * Plug & Play 2D
+ * @file profile.c
+ * @brief replays the example scenes against the recording shim
+ */
+
+#include <time.h>
+#include "pp2d.h"
+#include "c3d_trace.h"
+
+#define FRAMES 120
+#define MAX_SPRITES 4096
+#define GRID_COLUMNS 6
+#define GRID_ROWS 7
+#define LAYERS 4
+#define MAX_TRIANGLES 4096
+
+typedef struct {
+    float x, y;
+    float angle;
+    u32 color;
+    size_t id;
+} sprite_t;
+
+typedef struct {
+    const char* name;
+    bool blending;
+    bool rotating;
+    bool text;
+    bool deferredText;
+    bool geometrySprites;
+    bool batch;
+    bool interleaved;
+    bool sorted;
+    bool merged;
+    bool grid;
+    bool retained;
+    bool unchanged;
+    bool scrolled;
+    bool layered;
+    bool opaque;
+    bool clipped;
+    bool masked;
+} scene_t;
+
+// a triangle as the GPU rasterizes it: its vertices and the state in place when it was drawn
+typedef struct {
+    vertex_s vertices[3];
+    const void* target;
+    const void* program;
+    const void* texture;
+    u32 texEnv[4];
+    u32 scissor[3];
+    u32 stencil[4];
+} traced_triangle_t;
+
+static sprite_t sprites[MAX_SPRITES];
+static pp2d_sprite_s batch[MAX_SPRITES];
+
+static traced_triangle_t expectedTriangles[MAX_TRIANGLES];
+static traced_triangle_t actualTriangles[MAX_TRIANGLES];
+static const traced_triangle_t* sortedTriangles;
+
+static double now_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec*1e6 + ts.tv_nsec/1e3;
+}
+
+static void init_sprites(void)
+{
+    srand(0x3D5);
+    for (size_t i = 0; i < MAX_SPRITES; i++)
+    {
+        sprites[i].x = rand() % (PP2D_SCREEN_TOP_WIDTH - 32);
+        sprites[i].y = rand() % (PP2D_SCREEN_HEIGHT - 32);
+        sprites[i].angle = rand() % 360;
+        sprites[i].color = RGBA8(rand() % 0xFF, rand() % 0xFF, rand() % 0xFF, rand() % 0xFF);
+        sprites[i].id = rand() & 3;
+
+        batch[i].x = sprites[i].x;
+        batch[i].y = sprites[i].y;
+        batch[i].angle = sprites[i].angle;
+        batch[i].color = sprites[i].color;
+        batch[i].xbegin = (sprites[i].id / 2)*32;
+        batch[i].ybegin = (sprites[i].id % 2)*32;
+        batch[i].width = 32;
+        batch[i].height = 32;
+    }
+}
+
+static void draw_panel(const scene_t* scene)
+{
+    pp2d_draw_rectangle(0, 0, PP2D_SCREEN_BOTTOM_WIDTH, PP2D_SCREEN_HEIGHT, RGBA8(0x20, 0x20, 0x20, 0xFF));
+    for (int i = 0; i < 3; i++)
+    {
+        pp2d_draw_rectangle(20 + i*100, 160, 80, 50, RGBA8(0, 0xFF, i*0x40, 0xFF));
+    }
+
+    if (scene->text)
+    {
+        for (int line = 0; line < 10; line++)
+        {
+            pp2d_draw_textf(2, 2 + line*14, 0.5f, 0.5f, RGBA8(0xFE, 0xFE, 0xFE, 0xFF), "Line %d: The quick brown fox jumps", line);
+        }
+        pp2d_draw_text(2, 144, 0.5f, 0.5f, RGBA8(0xFF, 0xFF, 0, 0xFF), "\xE3\x81\x82\xE3\x81\x84\xE3\x81\x86\xE6\xBC\xA2\xE5\xAD\x97");
+    }
+}
+
+static void draw_frame(const scene_t* scene)
+{
+    pp2d_set_text_deferred(scene->deferredText);
+    pp2d_set_geometry_sprites(scene->geometrySprites);
+    pp2d_set_draw_sorting(scene->sorted);
+    pp2d_set_batch_merging(scene->merged);
+    pp2d_set_opaque_pass(scene->opaque);
+    pp2d_set_screen_unchanged(GFX_BOTTOM, scene->unchanged);
+    pp2d_frame_begin(GFX_TOP, GFX_LEFT);
+        if (scene->batch)
+        {
+            // blending and rotating, like the other scenes with both enabled
+            for (size_t i = 0; i < MAX_SPRITES; i++)
+            {
+                batch[i].angle++;
+            }
+            pp2d_texture_queue_batch(0, batch, MAX_SPRITES, 0);
+        }
+        for (size_t i = 0; scene->grid && i < GRID_COLUMNS*GRID_ROWS; i++)
+        {
+            // a menu of icons with a label next to each, none of them overlapping
+            const int x = (i % GRID_COLUMNS)*66;
+            const int y = (i / GRID_COLUMNS)*34;
+            pp2d_texture_select_part(0, x, y, (sprites[i].id / 2)*32, (sprites[i].id % 2)*32, 32, 32);
+            pp2d_texture_blend(sprites[i].color);
+            pp2d_texture_queue();
+            pp2d_draw_textf(x + 34, y + 8, 0.4f, 0.4f, RGBA8(0xFF, 0xFF, 0xFF, 0xFF), "#%zu", i);
+        }
+        for (int layer = 0; scene->layered && layer < LAYERS; layer++)
+        {
+            // opaque parallax backgrounds covering the whole screen, each one hiding most of the one behind
+            pp2d_set_draw_layer(layer);
+            pp2d_set_draw_opaque(true);
+            for (int tile = 0; tile < 13*8; tile++)
+            {
+                const int x = (tile % 13)*32 - (layer*7 % 32);
+                pp2d_texture_select_part(0, x, (tile / 13)*30, (layer % 2)*32, (layer / 2 % 2)*32, 32, 32);
+                pp2d_texture_queue();
+            }
+            pp2d_set_draw_opaque(false);
+        }
+        for (size_t i = 0; scene->layered && i < 128; i++)
+        {
+            // translucent sprites over the backgrounds
+            pp2d_texture_select_part(0, sprites[i].x, sprites[i].y, 32, 32, 32, 32);
+            pp2d_texture_blend(sprites[i].color);
+            pp2d_texture_queue();
+        }
+        pp2d_set_draw_layer(0);
+        if (scene->clipped)
+        {
+            // a scrolling list of 100 rows, of which the clip rect shows a few
+            static int scroll = 0;
+            scroll = (scroll + 3) % (100*24);
+            pp2d_push_clip(40, 40, 320, 160);
+            for (int row = 0; row < 100; row++)
+            {
+                const int y = 40 + row*24 - scroll;
+                pp2d_texture_select_part(0, 44, y, (row % 2)*32, 0, 32, 32);
+                pp2d_texture_blend(sprites[row].color);
+                pp2d_texture_queue();
+                pp2d_draw_textf(80, y + 4, 0.5f, 0.5f, RGBA8(0xFF, 0xFF, 0xFF, 0xFF), "Row %d", row);
+            }
+            pp2d_pop_clip();
+        }
+        if (scene->masked)
+        {
+            // sprites moving behind a rounded panel, shaped by a rectangle and a round sprite in each corner
+            pp2d_mask_begin();
+            pp2d_draw_rectangle(56, 40, 288, 160, RGBA8(0xFF, 0xFF, 0xFF, 0xFF));
+            pp2d_draw_rectangle(40, 56, 320, 128, RGBA8(0xFF, 0xFF, 0xFF, 0xFF));
+            for (int corner = 0; corner < 4; corner++)
+            {
+                pp2d_texture_select_part(0, corner % 2 ? 328 : 40, corner / 2 ? 168 : 40, 0, 0, 32, 32);
+                pp2d_texture_queue();
+            }
+            pp2d_mask_end();
+            for (size_t i = 0; i < 256; i++)
+            {
+                pp2d_texture_select_part(0, sprites[i].x, sprites[i].y, (sprites[i].id / 2)*32, (sprites[i].id % 2)*32, 32, 32);
+                pp2d_texture_blend(sprites[i].color);
+                pp2d_texture_queue();
+            }
+            pp2d_mask_disable();
+        }
+        for (size_t i = 0; !scene->batch && !scene->grid && !scene->layered && !scene->clipped && !scene->masked && i < MAX_SPRITES; i++)
+        {
+            // scrolled by half a screen, so about half of the sprites are out of it
+            const int x = sprites[i].x + (scene->scrolled ? PP2D_SCREEN_TOP_WIDTH/2 : 0);
+            pp2d_texture_select_part(0, x, sprites[i].y, (sprites[i].id / 2)*32, (sprites[i].id % 2)*32, 32, 32);
+            if (scene->blending)
+            {
+                pp2d_texture_blend(sprites[i].color);
+            }
+            if (scene->rotating)
+            {
+                pp2d_texture_rotate(sprites[i].angle++);
+            }
+            pp2d_texture_queue();
+
+            // a label every few sprites, the way a HUD interleaves text with sprites
+            if (scene->interleaved && i % 64 == 0)
+            {
+                pp2d_draw_textf(sprites[i].x, sprites[i].y, 0.4f, 0.4f, RGBA8(0xFF, 0xFF, 0xFF, 0xFF), "#%zu", i);
+            }
+        }
+
+    pp2d_frame_draw_on(GFX_BOTTOM, GFX_LEFT);
+        if (!scene->retained)
+        {
+            draw_panel(scene);
+        }
+        else
+        {
+            // the panel never changes, so it is only recorded the first frame
+            if (pp2d_static_layer_is_dirty(0))
+            {
+                pp2d_static_layer_begin(0);
+                    draw_panel(scene);
+                pp2d_static_layer_end();
+            }
+            pp2d_static_layer_draw(0);
+        }
+    pp2d_frame_end();
+}
+
+static size_t trace_triangles(traced_triangle_t* triangles, u32* draws)
+{
+    // indexed draws are unrolled through their indices, so triangles compare the same whichever way they were submitted
+    size_t count, size;
+    const trace_cmd_t* cmds = c3d_trace_commands(&count);
+    const u8* blob = c3d_trace_vertices(&size);
+    traced_triangle_t state;
+    memset(&state, 0, sizeof(state));
+
+    size_t triangleCount = 0;
+    *draws = 0;
+    for (size_t i = 0; i < count; i++)
+    {
+        const trace_cmd_t* cmd = &cmds[i];
+        switch (cmd->type)
+        {
+            case TRACE_FRAME_DRAW_ON: state.target = cmd->ptr; break;
+            case TRACE_BIND_PROGRAM: state.program = cmd->ptr; break;
+            case TRACE_TEX_BIND: state.texture = cmd->ptr; break;
+            case TRACE_TEXENV_SRC: memcpy(&state.texEnv[0], cmd->args, 2*sizeof(u32)); break;
+            case TRACE_TEXENV_FUNC: memcpy(&state.texEnv[2], cmd->args, 2*sizeof(u32)); break;
+            case TRACE_SCISSOR: memcpy(state.scissor, cmd->args, sizeof(state.scissor)); break;
+            case TRACE_STENCIL_TEST: memcpy(state.stencil, cmd->args, sizeof(state.stencil)); break;
+            default: break;
+        }
+        if (cmd->type != TRACE_DRAW_ARRAYS && cmd->type != TRACE_DRAW_ELEMENTS)
+        {
+            continue;
+        }
+
+        (*draws)++;
+        const vertex_s* vertices = (const vertex_s*)(blob + cmd->vtxOffset);
+        const u16* indices = cmd->type == TRACE_DRAW_ELEMENTS ? c3d_trace_indices(cmd) : NULL;
+        const u32 vertexCount = cmd->type == TRACE_DRAW_ELEMENTS ? cmd->args[1] : cmd->args[2];
+        for (u32 first = 0; first + 3 <= vertexCount && triangleCount < MAX_TRIANGLES; first += 3)
+        {
+            traced_triangle_t* triangle = &triangles[triangleCount++];
+            *triangle = state;
+            for (int k = 0; k < 3; k++)
+            {
+                triangle->vertices[k] = vertices[indices != NULL ? indices[first + k] : first + k];
+            }
+        }
+    }
+    return triangleCount;
+}
+
+static size_t capture_scene(const scene_t* scene, traced_triangle_t* triangles, u32* draws)
+{
+    // the first frame records what the scene keeps, the second one is traced
+    pp2d_static_layer_mark_dirty(0);
+    draw_frame(scene);
+    c3d_trace_capture(true);
+    c3d_trace_reset();
+    draw_frame(scene);
+    c3d_trace_capture(false);
+    return trace_triangles(triangles, draws);
+}
+
+static int compare_triangles(const void* a, const void* b)
+{
+    // by contents, then by submission order, so equal triangles are paired in the order they came
+    const u32 ia = *(const u32*)a;
+    const u32 ib = *(const u32*)b;
+    const int order = memcmp(&sortedTriangles[ia], &sortedTriangles[ib], sizeof(traced_triangle_t));
+    return order != 0 ? order : (ia > ib) - (ia < ib);
+}
+
+static void triangle_bounds(const traced_triangle_t* triangle, float* bounds)
+{
+    bounds[0] = bounds[1] = INFINITY;
+    bounds[2] = bounds[3] = -INFINITY;
+    for (int k = 0; k < 3; k++)
+    {
+#if PP2D_COMPACT_VERTICES
+        const float x = triangle->vertices[k].x / 16.0f;
+        const float y = triangle->vertices[k].y / 16.0f;
+#else
+        const float x = triangle->vertices[k].x;
+        const float y = triangle->vertices[k].y;
+#endif
+        bounds[0] = fminf(bounds[0], x);
+        bounds[1] = fminf(bounds[1], y);
+        bounds[2] = fmaxf(bounds[2], x);
+        bounds[3] = fmaxf(bounds[3], y);
+    }
+}
+
+static bool check_scene(const scene_t* reference, const scene_t* scene)
+{
+    // the scene draws the same triangles as the reference, and the ones overlapping on a target keep their painter's order
+    static u32 expectedOrder[MAX_TRIANGLES], actualOrder[MAX_TRIANGLES], position[MAX_TRIANGLES];
+    static float bounds[MAX_TRIANGLES][4];
+    memset(expectedTriangles, 0, sizeof(expectedTriangles));
+    memset(actualTriangles, 0, sizeof(actualTriangles));
+    u32 expectedDraws, actualDraws;
+    const size_t count = capture_scene(reference, expectedTriangles, &expectedDraws);
+    const size_t actualCount = capture_scene(scene, actualTriangles, &actualDraws);
+
+    for (u32 i = 0; i < MAX_TRIANGLES; i++)
+    {
+        expectedOrder[i] = actualOrder[i] = i;
+    }
+    sortedTriangles = expectedTriangles;
+    qsort(expectedOrder, count, sizeof(u32), compare_triangles);
+    sortedTriangles = actualTriangles;
+    qsort(actualOrder, actualCount, sizeof(u32), compare_triangles);
+
+    size_t missing = count > actualCount ? count - actualCount : actualCount - count;
+    for (size_t i = 0; i < count && i < actualCount; i++)
+    {
+        if (memcmp(&expectedTriangles[expectedOrder[i]], &actualTriangles[actualOrder[i]], sizeof(traced_triangle_t)) != 0)
+        {
+            missing++;
+        }
+        position[expectedOrder[i]] = actualOrder[i];
+    }
+
+    size_t outOfOrder = 0;
+    for (size_t i = 0; missing == 0 && i < count; i++)
+    {
+        triangle_bounds(&expectedTriangles[i], bounds[i]);
+    }
+    for (size_t i = 0; missing == 0 && i < count; i++)
+    {
+        for (size_t j = i + 1; j < count; j++)
+        {
+            const bool overlap = expectedTriangles[i].target == expectedTriangles[j].target
+                && bounds[i][0] < bounds[j][2] && bounds[j][0] < bounds[i][2] && bounds[i][1] < bounds[j][3] && bounds[j][1] < bounds[i][3];
+            outOfOrder += overlap && position[i] > position[j];
+        }
+    }
+
+    const bool match = count > 0 && count < MAX_TRIANGLES && missing == 0 && outOfOrder == 0 && actualDraws <= expectedDraws;
+    printf("%-10s vs %-8s %4u -> %4u draws, %5zu triangles, %zu missing, %zu out of order: %s\n", scene->name, reference->name,
+        expectedDraws, actualDraws, count, missing, outOfOrder, match ? "ok" : "MISMATCH");
+    return match;
+}
+
+static const scene_t* find_scene(const scene_t* scenes, size_t count, const char* name)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        if (strcmp(scenes[i].name, name) == 0)
+        {
+            return &scenes[i];
+        }
+    }
+    return NULL;
+}
+
+static void run_scene(const scene_t* scene)
+{
+    c3d_trace_capture(false);
+    c3d_trace_reset();
+    pp2d_reset_state_stats();
+    pp2d_static_layer_mark_dirty(0);
+
+    double start = now_us();
+    for (int frame = 0; frame < FRAMES; frame++)
+    {
+        draw_frame(scene);
+    }
+    double elapsed = now_us() - start;
+
+    const trace_stats_t* stats = c3d_trace_stats();
+    const u32* c = stats->counts;
+    u32 texEnv = c[TRACE_TEXENV_SRC] + c[TRACE_TEXENV_OP] + c[TRACE_TEXENV_FUNC] + c[TRACE_TEXENV_COLOR];
+
+    // state changes pp2d skipped because its shadow state already matched
+    pp2d_state_stats_s state;
+    pp2d_get_state_stats(&state);
+    u32 skipped = state.programBindsSkipped + state.projectionUploadsSkipped + state.scissorChangesSkipped + state.stencilChangesSkipped + state.texEnvChangesSkipped + state.textureBindsSkipped;
+    u32 culled = state.glyphsCulled + state.rectanglesCulled + state.spritesCulled;
+
+    printf("%-10s %8.1f %8.1f %8.1f %8.1f %8.1f %8.1f %8.1f %10.1f %8.1f %10.1f\n", scene->name,
+        (double)(c[TRACE_DRAW_ARRAYS] + c[TRACE_DRAW_ELEMENTS]) / FRAMES,
+        (double)c[TRACE_TEX_BIND] / FRAMES,
+        (double)texEnv / FRAMES,
+        (double)c[TRACE_UNIFORM] / FRAMES,
+        (double)skipped / FRAMES,
+        (double)culled / FRAMES,
+        (double)stats->vertices / FRAMES,
+        (double)stats->vertexBytes / FRAMES,
+        (double)c[TRACE_DISPLAY_TRANSFER] / FRAMES,
+        elapsed / FRAMES);
+}
+
+int main(int argc, char* argv[])
+{
+    static const scene_t scenes[] = {
+        { "plain",    false, false, false, false, false, false, false, false, false, false, false, false, false, false, false, false, false },
+        { "blending", true,  false, false, false, false, false, false, false, false, false, false, false, false, false, false, false, false },
+        { "scrolled", true,  false, false, false, false, false, false, false, false, false, false, false, true,  false, false, false, false },
+        { "rotating", false, true,  false, false, false, false, false, false, false, false, false, false, false, false, false, false, false },
+        { "text",     false, false, true,  false, false, false, false, false, false, false, false, false, false, false, false, false, false },
+        { "deferred", false, false, true,  true,  false, false, false, false, false, false, false, false, false, false, false, false, false },
+        { "geometry", true,  true,  false, false, true,  false, false, false, false, false, false, false, false, false, false, false, false },
+        { "batch",    true,  true,  false, false, false, true,  false, false, false, false, false, false, false, false, false, false, false },
+        { "labels",   true,  false, true,  false, false, false, true,  false, false, false, false, false, false, false, false, false, false },
+        { "sorted",   true,  false, true,  false, false, false, true,  true,  false, false, false, false, false, false, false, false, false },
+        { "mixed",    true,  false, true,  false, false, false, true,  false, true,  false, false, false, false, false, false, false, false },
+        { "menu",     true,  false, true,  false, false, false, false, false, false, true,  false, false, false, false, false, false, false },
+        { "retained", true,  false, true,  false, false, false, false, false, false, true,  true,  false, false, false, false, false, false },
+        { "unchanged",true,  false, true,  false, false, false, false, false, false, true,  true,  true,  false, false, false, false, false },
+        { "merged",   true,  false, true,  false, false, false, false, false, true,  true,  false, false, false, false, false, false, false },
+        { "layered",  false, false, false, false, false, false, false, false, false, false, false, false, false, true,  false, false, false },
+        { "opaque",   false, false, false, false, false, false, false, false, false, false, false, false, false, true,  true,  false, false },
+        { "clipped",  true,  false, true,  false, false, false, false, false, false, false, false, false, false, false, false, true,  false },
+        { "masked",   true,  false, false, false, false, false, false, false, false, false, false, false, false, false, false, false, true  },
+        { "all",      true,  true,  true,  false, false, false, false, false, false, false, false, false, false, false, false, false, false },
+    };
+
+    init_sprites();
+    pp2d_init();
+
+    // a 64x64 sheet holding the four 32x32 sprites the example uses
+    u32* sheet = linearAlloc(64*64*4);
+    memset(sheet, 0xFF, 64*64*4);
+    pp2d_load_texture_memory(0, sheet, 64, 64, GX_TRANSFER_FMT_RGBA8);
+    linearFree(sheet);
+
+    bool accurate = true;
+    if (argc > 1 && strcmp(argv[1], "--dump") == 0)
+    {
+        c3d_trace_capture(true);
+        c3d_trace_reset();
+        draw_frame(&scenes[sizeof(scenes)/sizeof(scenes[0]) - 1]);
+        c3d_trace_dump(stdout);
+    }
+    else
+    {
+        printf("%-10s %8s %8s %8s %8s %8s %8s %8s %10s %8s %10s\n", "scene", "draws", "binds", "texenv", "unifs", "skipped", "culled", "verts", "vtxbytes", "xfers", "us/frame");
+        for (size_t i = 0; i < sizeof(scenes)/sizeof(scenes[0]); i++)
+        {
+            run_scene(&scenes[i]);
+        }
+
+        // retained and merged draws against the menu drawn immediately
+        const scene_t* menu = find_scene(scenes, sizeof(scenes)/sizeof(scenes[0]), "menu");
+        accurate = check_scene(menu, find_scene(scenes, sizeof(scenes)/sizeof(scenes[0]), "retained")) && accurate;
+        accurate = check_scene(menu, find_scene(scenes, sizeof(scenes)/sizeof(scenes[0]), "merged")) && accurate;
+    }
+
+    pp2d_exit();
+    return accurate ? 0 : 1;
+}
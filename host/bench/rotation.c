@@ -0,0 +1,184 @@
+/*  This file is part of pp2d
+>   Copyright (C) 2017/2018 Bernardo Giordano
+>
+>   This program is free software: you can redistribute it and/or modify
+>   it under the terms of the GNU General Public License as published by
+>   the Free Software Foundation, either version 3 of the License, or
+>   (at your option) any later version.
+>
+>   This program is distributed in the hope that it will be useful,
+>   but WITHOUT ANY WARRANTY; without even the implied warranty of
+>   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+>   GNU General Public License for more details.
+>
+>   You should have received a copy of the GNU General Public License
+>   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+>   See LICENSE for information.
+>
+>   https://discord.gg/bGKEyfY
+*/
+
+/**
+ * Plug & Play 2D
+ * @file rotation.c
+ * @brief accuracy and throughput of rotated sprites
+ * @note the Makefile also builds it against pp2d with PP2D_LUT_ROTATION=0 as rotation_libm, to time the sinf/cosf path
+ */
+
+#include <time.h>
+#include "pp2d.h"
+#include "c3d_trace.h"
+
+#define SPRITES 8192
+#define ROUNDS 200
+// largest corner error tolerated, compact vertices are rounded to 1/16th of pixel
+#define MAX_CORNER_ERROR 0.1
+
+static pp2d_sprite_s sprites[SPRITES];
+
+static double now_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec*1e6 + ts.tv_nsec/1e3;
+}
+
+static void init_sprites(bool rotated)
+{
+    srand(0x3D5);
+    for (size_t i = 0; i < SPRITES; i++)
+    {
+        sprites[i].x = rand() % PP2D_SCREEN_TOP_WIDTH;
+        sprites[i].y = rand() % PP2D_SCREEN_HEIGHT;
+        // angles past a full turn either way, like an angle incremented every frame, and a few too large for the table's conversion
+        sprites[i].angle = rotated ? rand()*7200.0f/RAND_MAX - 3600.0f : 0;
+        sprites[i].angle = rotated && i % 1024 == 0 ? (i % 2048 == 0 ? 1e30f : -3e12f) : sprites[i].angle;
+        sprites[i].color = PP2D_DEFAULT_COLOR_NEUTRAL;
+        sprites[i].xbegin = 0;
+        sprites[i].ybegin = 0;
+        sprites[i].width = 16 + (i % 8)*32;
+        sprites[i].height = 16 + (i % 5)*32;
+    }
+}
+
+static float vertex_coord(const vertex_s* vtx, int axis)
+{
+#if PP2D_COMPACT_VERTICES
+    return (axis == 0 ? vtx->x : vtx->y) / 16.0f;
+#else
+    return axis == 0 ? vtx->x : vtx->y;
+#endif
+}
+
+static bool measure_accuracy(void)
+{
+    init_sprites(true);
+    c3d_trace_capture(true);
+    c3d_trace_reset();
+    pp2d_frame_begin(GFX_TOP, GFX_LEFT);
+        pp2d_texture_queue_batch(0, sprites, SPRITES, 0);
+    pp2d_frame_end();
+    c3d_trace_capture(false);
+
+    size_t size;
+    const vertex_s* vertices = (const vertex_s*)c3d_trace_vertices(&size);
+    if (size < SPRITES*PP2D_QUAD_VERTICES*sizeof(vertex_s))
+    {
+        printf("missing vertices: %zu bytes\n", size);
+        return false;
+    }
+
+    // corners as written by pp2d: top left, bottom left, top right, bottom right
+    static const int corners[4][2] = { {-1, -1}, {-1, 1}, {1, -1}, {1, 1} };
+#if PP2D_INDEXED_QUADS
+    static const int slots[4] = { 0, 1, 2, 3 };
+#else
+    static const int slots[4] = { 0, 1, 2, 5 };
+#endif
+
+    double maxError = 0, sumError = 0;
+    for (size_t i = 0; i < SPRITES; i++)
+    {
+        const double rad = fmod(sprites[i].angle, 360) * M_PI / 180;
+        const double c = cos(rad), s = sin(rad);
+        const double hw = sprites[i].width / 2.0, hh = sprites[i].height / 2.0;
+        const double cx = sprites[i].x + hw, cy = sprites[i].y + hh;
+        for (int k = 0; k < 4; k++)
+        {
+            const double ox = corners[k][0]*hw, oy = corners[k][1]*hh;
+            const vertex_s* vtx = &vertices[i*PP2D_QUAD_VERTICES + slots[k]];
+            const double dx = vertex_coord(vtx, 0) - (cx + c*ox - s*oy);
+            const double dy = vertex_coord(vtx, 1) - (cy + s*ox + c*oy);
+            const double error = sqrt(dx*dx + dy*dy);
+            maxError = error > maxError ? error : maxError;
+            sumError += error;
+        }
+    }
+
+    const bool accurate = maxError <= MAX_CORNER_ERROR;
+    printf("corner error vs double precision: max %.5f px, mean %.5f px (sprites up to 240x144): %s\n", maxError, sumError / (SPRITES*4), accurate ? "ok" : "MISMATCH");
+    return accurate;
+}
+
+static bool check_non_finite(void)
+{
+    // NaN and infinite angles have no sine: the lookup table draws them unrotated, sinf and cosf leave the corners undefined
+    static const float angles[] = { NAN, INFINITY, -INFINITY };
+    pp2d_sprite_s sprite = { .x = 100, .y = 50, .width = 32, .height = 16, .color = PP2D_DEFAULT_COLOR_NEUTRAL };
+    bool defined = true;
+    for (size_t i = 0; i < sizeof(angles)/sizeof(angles[0]); i++)
+    {
+        sprite.angle = angles[i];
+        c3d_trace_capture(true);
+        c3d_trace_reset();
+        pp2d_frame_begin(GFX_TOP, GFX_LEFT);
+            pp2d_texture_queue_batch(0, &sprite, 1, 0);
+        pp2d_frame_end();
+        c3d_trace_capture(false);
+
+        size_t size;
+        const vertex_s* vtx = (const vertex_s*)c3d_trace_vertices(&size);
+        const bool unrotated = size >= sizeof(vertex_s) && vertex_coord(vtx, 0) == sprite.x && vertex_coord(vtx, 1) == sprite.y;
+        const bool expected = !PP2D_LUT_ROTATION || unrotated;
+        printf("angle %f: top left corner at %f, %f: %s\n", angles[i], size >= sizeof(vertex_s) ? vertex_coord(vtx, 0) : 0,
+            size >= sizeof(vertex_s) ? vertex_coord(vtx, 1) : 0, expected ? "ok" : "MISMATCH");
+        defined = defined && expected;
+    }
+    return defined;
+}
+
+static double measure_throughput(bool rotated)
+{
+    init_sprites(rotated);
+    c3d_trace_reset();
+
+    double start = now_us();
+    for (int round = 0; round < ROUNDS; round++)
+    {
+        pp2d_frame_begin(GFX_TOP, GFX_LEFT);
+            pp2d_texture_queue_batch(0, sprites, SPRITES, 0);
+        pp2d_frame_end();
+    }
+    return (now_us() - start) * 1000 / ((double)ROUNDS * SPRITES);
+}
+
+int main(void)
+{
+    pp2d_init();
+
+    u32* sheet = linearAlloc(256*256*4);
+    memset(sheet, 0xFF, 256*256*4);
+    pp2d_load_texture_memory(0, sheet, 256, 256, GX_TRANSFER_FMT_RGBA8);
+    linearFree(sheet);
+
+    printf("rotation: %s\n", PP2D_LUT_ROTATION ? "lookup table" : "sinf/cosf");
+    const bool accurate = measure_accuracy();
+    const bool defined = check_non_finite();
+
+    const double unrotated = measure_throughput(false);
+    const double rotated = measure_throughput(true);
+    printf("queue cost: %.2f ns/sprite unrotated, %.2f ns/sprite rotated (+%.2f)\n", unrotated, rotated, rotated - unrotated);
+
+    pp2d_exit();
+    return accurate && defined ? 0 : 1;
+}
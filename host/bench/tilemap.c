@@ -0,0 +1,327 @@
+/*  This file is part of pp2d
+>   Copyright (C) 2017/2018 Bernardo Giordano
+>
+>   This program is free software: you can redistribute it and/or modify
+>   it under the terms of the GNU General Public License as published by
+>   the Free Software Foundation, either version 3 of the License, or
+>   (at your option) any later version.
+>
+>   This program is distributed in the hope that it will be useful,
+>   but WITHOUT ANY WARRANTY; without even the implied warranty of
+>   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+>   GNU General Public License for more details.
+>
+>   You should have received a copy of the GNU General Public License
+>   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+>   See LICENSE for information.
+>
+>   https://discord.gg/bGKEyfY
+*/
+
+/**
+ * Plug & Play 2D
+ * @file tilemap.c
+ * @brief a scrolling tile map drawn tile by tile compared with cached tile map chunks
+ */
+
+#include <time.h>
+#include "pp2d.h"
+#include "c3d_trace.h"
+
+#define COLUMNS 256
+#define ROWS 64
+#define TILE 16
+#define FRAMES 1000
+// tiles changed every frame by the edited mode
+#define EDITS 4
+// largest difference tolerated between tiles drawn from chunks and queued ones, in clip space
+#define MAX_CLIP_ERROR 1e-4f
+#define MAX_TILES 1024
+
+typedef enum {
+    MODE_QUEUED,
+    MODE_TILEMAP,
+    MODE_EDITED
+} map_mode_t;
+
+static const char* modeNames[] = { "queued", "tilemap", "edited" };
+
+static u16 tiles[ROWS][COLUMNS];
+
+// a quad where the GPU puts it: corners in clip space and their texture coordinates
+typedef struct {
+    float x[4], y[4], u[4], v[4];
+    u32 color;
+} clip_quad_t;
+
+// projection in place when the trace was reset, pp2d only sets it again when it changes
+static C3D_FVec startProjection[4];
+static clip_quad_t queuedQuads[MAX_TILES];
+static clip_quad_t mapQuads[MAX_TILES];
+
+static double now_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec*1e6 + ts.tv_nsec/1e3;
+}
+
+static void init_tiles(void)
+{
+    // ground at the bottom, sky above with a few floating tiles
+    srand(0x3D5);
+    for (int row = 0; row < ROWS; row++)
+    {
+        for (int column = 0; column < COLUMNS; column++)
+        {
+            tiles[row][column] = row > ROWS/2 ? 1 + rand() % 8 : (rand() % 6 == 0 ? 9 + rand() % 8 : 0);
+        }
+    }
+}
+
+static void draw_queued(int cameraX, int cameraY)
+{
+    // what a game does without tile maps: every visible tile through the texture state
+    for (int row = cameraY > 0 ? cameraY / TILE : 0; row <= (cameraY + PP2D_SCREEN_HEIGHT) / TILE && row < ROWS; row++)
+    {
+        for (int column = cameraX > 0 ? cameraX / TILE : 0; column <= (cameraX + PP2D_SCREEN_TOP_WIDTH) / TILE && column < COLUMNS; column++)
+        {
+            const u16 tile = tiles[row][column];
+            if (tile != 0)
+            {
+                pp2d_texture_select_part(0, column*TILE - cameraX, row*TILE - cameraY, (tile - 1) % 8*TILE, (tile - 1) / 8*TILE, TILE, TILE);
+                pp2d_texture_queue();
+            }
+        }
+    }
+}
+
+static float vertex_value(s16 compact, float value, float one)
+{
+#if PP2D_COMPACT_VERTICES
+    (void)value;
+    return compact / one;
+#else
+    (void)compact;
+    (void)one;
+    return value;
+#endif
+}
+
+static size_t collect_quads(clip_quad_t* quads)
+{
+    // the vertices of each draw go through the projection set before it, and quads off the target are left out
+#if PP2D_INDEXED_QUADS
+    static const int slots[4] = { 0, 1, 2, 3 };
+#else
+    static const int slots[4] = { 0, 1, 2, 5 };
+#endif
+    const int projection = shaderInstanceGetUniformLocation(NULL, "projection");
+    size_t count, size;
+    const trace_cmd_t* cmds = c3d_trace_commands(&count);
+    const u8* blob = c3d_trace_vertices(&size);
+    C3D_FVec matrix[4];
+    memcpy(matrix, startProjection, sizeof(matrix));
+
+    size_t quadCount = 0;
+    for (size_t i = 0; i < count; i++)
+    {
+        if (cmds[i].type == TRACE_UNIFORM && cmds[i].args[0] == GPU_VERTEX_SHADER && (int)cmds[i].args[1] == projection && c3d_trace_uniform_values(&cmds[i]) != NULL)
+        {
+            memcpy(matrix, c3d_trace_uniform_values(&cmds[i]), sizeof(matrix));
+        }
+        if (cmds[i].type != TRACE_DRAW_ARRAYS && cmds[i].type != TRACE_DRAW_ELEMENTS)
+        {
+            continue;
+        }
+
+        const vertex_s* vertices = (const vertex_s*)(blob + cmds[i].vtxOffset);
+        for (size_t first = 0; first + PP2D_QUAD_VERTICES <= cmds[i].vtxBytes / sizeof(vertex_s); first += PP2D_QUAD_VERTICES)
+        {
+            clip_quad_t quad;
+            float left = INFINITY, top = INFINITY, right = -INFINITY, bottom = -INFINITY;
+            for (int k = 0; k < 4; k++)
+            {
+                const vertex_s* vtx = &vertices[first + slots[k]];
+                const float x = vertex_value(vtx->x, vtx->x, 16.0f);
+                const float y = vertex_value(vtx->y, vtx->y, 16.0f);
+                const float z = vertex_value(vtx->z, vtx->z, 32767.0f);
+                quad.x[k] = matrix[0].x*x + matrix[0].y*y + matrix[0].z*z + matrix[0].w;
+                quad.y[k] = matrix[1].x*x + matrix[1].y*y + matrix[1].z*z + matrix[1].w;
+                quad.u[k] = vertex_value(vtx->u, vtx->u, 32767.0f);
+                quad.v[k] = vertex_value(vtx->v, vtx->v, 32767.0f);
+                left = fminf(left, quad.x[k]);
+                top = fminf(top, quad.y[k]);
+                right = fmaxf(right, quad.x[k]);
+                bottom = fmaxf(bottom, quad.y[k]);
+            }
+            quad.color = vertices[first].color;
+
+            if (right > -1 + MAX_CLIP_ERROR && left < 1 - MAX_CLIP_ERROR && bottom > -1 + MAX_CLIP_ERROR && top < 1 - MAX_CLIP_ERROR && quadCount < MAX_TILES)
+            {
+                quads[quadCount++] = quad;
+            }
+        }
+    }
+    return quadCount;
+}
+
+static int compare_quads(const void* a, const void* b)
+{
+    const clip_quad_t* qa = a;
+    const clip_quad_t* qb = b;
+    if (fabsf(qa->x[0] - qb->x[0]) > MAX_CLIP_ERROR)
+    {
+        return qa->x[0] < qb->x[0] ? -1 : 1;
+    }
+    if (fabsf(qa->y[0] - qb->y[0]) > MAX_CLIP_ERROR)
+    {
+        return qa->y[0] < qb->y[0] ? -1 : 1;
+    }
+    return 0;
+}
+
+static bool same_quad(const clip_quad_t* a, const clip_quad_t* b)
+{
+    for (int k = 0; k < 4; k++)
+    {
+        if (fabsf(a->x[k] - b->x[k]) > MAX_CLIP_ERROR || fabsf(a->y[k] - b->y[k]) > MAX_CLIP_ERROR ||
+            fabsf(a->u[k] - b->u[k]) > 1e-3f || fabsf(a->v[k] - b->v[k]) > 1e-3f)
+        {
+            return false;
+        }
+    }
+    return a->color == b->color;
+}
+
+static void reset_capture(void)
+{
+    c3d_trace_reset();
+    memcpy(startProjection, c3d_trace_uniform(GPU_VERTEX_SHADER, shaderInstanceGetUniformLocation(NULL, "projection")), sizeof(startProjection));
+}
+
+static bool check_accuracy(void)
+{
+    // the tiles a camera sees, queued one by one and drawn from the chunks, are the same quads
+    static const int cameras[][2] = { {0, 0}, {37, (ROWS/2 - 4)*TILE + 5}, {COLUMNS*TILE - PP2D_SCREEN_TOP_WIDTH - 3, (ROWS - 15)*TILE + 11}, {-20, -30} };
+    pp2d_tilemap_set_tiles(0, &tiles[0][0]);
+    c3d_trace_capture(true);
+
+    int mismatches = 0;
+    size_t checked = 0;
+    for (size_t camera = 0; camera < sizeof(cameras)/sizeof(cameras[0]); camera++)
+    {
+        const int cameraX = cameras[camera][0], cameraY = cameras[camera][1];
+        reset_capture();
+        pp2d_frame_begin(GFX_TOP, GFX_LEFT);
+            draw_queued(cameraX, cameraY);
+        pp2d_frame_end();
+        const size_t queued = collect_quads(queuedQuads);
+
+        reset_capture();
+        pp2d_frame_begin(GFX_TOP, GFX_LEFT);
+            pp2d_tilemap_draw(0, cameraX, cameraY);
+        pp2d_frame_end();
+        const size_t drawn = collect_quads(mapQuads);
+
+        qsort(queuedQuads, queued, sizeof(clip_quad_t), compare_quads);
+        qsort(mapQuads, drawn, sizeof(clip_quad_t), compare_quads);
+        mismatches += queued != drawn;
+        for (size_t i = 0; i < queued && i < drawn; i++)
+        {
+            mismatches += !same_quad(&queuedQuads[i], &mapQuads[i]);
+        }
+        checked += queued;
+    }
+    c3d_trace_capture(false);
+
+    printf("%zu tiles seen from %zu cameras, drawn from chunks vs queued: %d mismatches: %s\n",
+        checked, sizeof(cameras)/sizeof(cameras[0]), mismatches, mismatches == 0 ? "ok" : "MISMATCH");
+    return mismatches == 0;
+}
+
+static double measure_frame_cost(void)
+{
+    // beginning and ending a frame that draws something, display transfers included
+    const double start = now_us();
+    for (int frame = 0; frame < FRAMES; frame++)
+    {
+        pp2d_frame_begin(GFX_TOP, GFX_LEFT);
+            pp2d_texture_select_part(0, 0, 0, 0, 0, TILE, TILE);
+            pp2d_texture_queue();
+        pp2d_frame_end();
+    }
+    return (now_us() - start) / FRAMES;
+}
+
+static void draw_frames(map_mode_t mode)
+{
+    for (int frame = 0; frame < FRAMES; frame++)
+    {
+        const int cameraX = frame*3 % (COLUMNS*TILE - PP2D_SCREEN_TOP_WIDTH);
+        const int cameraY = (ROWS/2 - 4)*TILE + frame % 32;
+        if (mode == MODE_EDITED)
+        {
+            for (int edit = 0; edit < EDITS; edit++)
+            {
+                const int column = (cameraX + rand() % PP2D_SCREEN_TOP_WIDTH) / TILE;
+                pp2d_tilemap_set_tile(0, column, ROWS/2 + 1 + rand() % 4, 1 + rand() % 16);
+            }
+        }
+
+        pp2d_frame_begin(GFX_TOP, GFX_LEFT);
+            if (mode == MODE_QUEUED)
+            {
+                draw_queued(cameraX, cameraY);
+            }
+            else
+            {
+                pp2d_tilemap_draw(0, cameraX, cameraY);
+            }
+        pp2d_frame_end();
+    }
+}
+
+static void measure(map_mode_t mode, double frameCost)
+{
+    // a first round writes the chunks along the way and warms the caches, the second one is timed
+    pp2d_tilemap_set_tiles(0, &tiles[0][0]);
+    draw_frames(mode);
+    c3d_trace_reset();
+
+    const double start = now_us();
+    draw_frames(mode);
+    const double elapsed = (now_us() - start) / FRAMES - frameCost;
+
+    const trace_stats_t* stats = c3d_trace_stats();
+    printf("%-8s %8.1f %8.1f %10.1f %10.1f\n", modeNames[mode],
+        (double)(stats->counts[TRACE_DRAW_ELEMENTS] + stats->counts[TRACE_DRAW_ARRAYS]) / FRAMES,
+        (double)stats->counts[TRACE_UNIFORM] / FRAMES,
+        (double)stats->vertexBytes / FRAMES / 1024,
+        elapsed);
+}
+
+int main(void)
+{
+    pp2d_init();
+
+    // a 128x32 sheet of 16 tiles
+    u32* sheet = linearAlloc(128*32*4);
+    memset(sheet, 0xFF, 128*32*4);
+    pp2d_load_texture_memory(0, sheet, 128, 32, GX_TRANSFER_FMT_RGBA8);
+    linearFree(sheet);
+
+    init_tiles();
+    pp2d_tilemap_create(0, 0, COLUMNS, ROWS, TILE, TILE);
+    const bool accurate = check_accuracy();
+
+    printf("%dx%d map of %dx%d tiles, scrolling, CPU time beyond a frame drawing a single tile\n", COLUMNS, ROWS, TILE, TILE);
+    const double frameCost = measure_frame_cost();
+    printf("%-8s %8s %8s %10s %10s\n", "mode", "draws", "unifs", "vtx KB", "us/frame");
+    measure(MODE_QUEUED, frameCost);
+    measure(MODE_TILEMAP, frameCost);
+    measure(MODE_EDITED, frameCost);
+
+    pp2d_exit();
+    return accurate ? 0 : 1;
+}
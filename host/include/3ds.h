@@ -0,0 +1,166 @@
+/*  This file is part of pp2d
+>   Copyright (C) 2017/2018 Bernardo Giordano
+>
+>   This program is free software: you can redistribute it and/or modify
+>   it under the terms of the GNU General Public License as published by
+>   the Free Software Foundation, either version 3 of the License, or
+>   (at your option) any later version.
+>
+>   This program is distributed in the hope that it will be useful,
+>   but WITHOUT ANY WARRANTY; without even the implied warranty of
+>   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+>   GNU General Public License for more details.
+>
+>   You should have received a copy of the GNU General Public License
+>   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+>   See LICENSE for information.
+>
+>   https://discord.gg/bGKEyfY
+*/
+
+/**
+ * Plug & Play 2D
+ * @file 3ds.h
+ * @brief host replacement for the subset of libctru used by pp2d
+ */
+
+#ifndef PP2D_HOST_3DS_H
+#define PP2D_HOST_3DS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef uint8_t u8;
+typedef uint16_t u16;
+typedef uint32_t u32;
+typedef uint64_t u64;
+typedef int8_t s8;
+typedef int16_t s16;
+typedef int32_t s32;
+typedef int64_t s64;
+typedef s32 Result;
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+// gfx
+typedef enum {
+    GFX_TOP = 0,
+    GFX_BOTTOM = 1
+} gfxScreen_t;
+
+typedef enum {
+    GFX_LEFT = 0,
+    GFX_RIGHT = 1
+} gfx3dSide_t;
+
+void gfxInitDefault(void);
+void gfxExit(void);
+void gfxSet3D(bool enable);
+void gfxSetDoubleBuffering(gfxScreen_t screen, bool doubleBuffering);
+
+// gx
+typedef enum {
+    GX_TRANSFER_FMT_RGBA8 = 0,
+    GX_TRANSFER_FMT_RGB8 = 1,
+    GX_TRANSFER_FMT_RGB565 = 2,
+    GX_TRANSFER_FMT_RGB5A1 = 3,
+    GX_TRANSFER_FMT_RGBA4 = 4
+} GX_TRANSFER_FORMAT;
+
+typedef enum {
+    GX_TRANSFER_SCALE_NO = 0,
+    GX_TRANSFER_SCALE_X = 1,
+    GX_TRANSFER_SCALE_XY = 2
+} GX_TRANSFER_SCALE;
+
+#define GX_TRANSFER_FLIP_VERT(x)  ((x)<<0)
+#define GX_TRANSFER_OUT_TILED(x)  ((x)<<1)
+#define GX_TRANSFER_RAW_COPY(x)   ((x)<<3)
+#define GX_TRANSFER_IN_FORMAT(x)  ((x)<<8)
+#define GX_TRANSFER_OUT_FORMAT(x) ((x)<<12)
+#define GX_TRANSFER_SCALING(x)    ((x)<<24)
+#define GX_BUFFER_DIM(w, h) (((h)<<16)|((w)&0xFFFF))
+
+Result GSPGPU_FlushDataCache(const void* adr, u32 size);
+void gspWaitForPPF(void);
+
+// linear memory
+void* linearAlloc(size_t size);
+void linearFree(void* mem);
+
+// utf
+ssize_t decode_utf8(uint32_t* out, const uint8_t* in);
+
+// system font
+typedef struct {
+    u8 cellWidth;
+    u8 cellHeight;
+    u8 baselinePos;
+    u8 maxCharWidth;
+    u32 sheetSize;
+    u16 nSheets;
+    u16 sheetFmt;
+    u16 nRows;
+    u16 nLines;
+    u16 sheetWidth;
+    u16 sheetHeight;
+    u8* sheetData;
+} TGLP_s;
+
+typedef struct {
+    s8 left;
+    u8 glyphWidth;
+    u8 charWidth;
+} charWidthInfo_s;
+
+typedef struct {
+    u32 signature;
+    u32 sectionSize;
+    u8 fontType;
+    u8 lineFeed;
+    u16 alterCharIndex;
+    charWidthInfo_s defaultWidth;
+    u8 encoding;
+    TGLP_s* tglp;
+} FINF_s;
+
+typedef struct {
+    int sheetIndex;
+    float xOffset;
+    float xAdvance;
+    float width;
+    struct {
+        float left, top, right, bottom;
+    } texcoord;
+    struct {
+        float left, top, right, bottom;
+    } vtxcoord;
+} fontGlyphPos_s;
+
+enum {
+    GLYPH_POS_CALC_VTXCOORD = 1 << 0,
+    GLYPH_POS_AT_BASELINE = 1 << 1,
+    GLYPH_POS_Y_POINTS_UP = 1 << 2
+};
+
+Result fontEnsureMapped(void);
+FINF_s* fontGetInfo(void);
+TGLP_s* fontGetGlyphInfo(void);
+void* fontGetGlyphSheetTex(int sheetIndex);
+int fontGlyphIndexFromCodePoint(u32 codePoint);
+charWidthInfo_s* fontGetCharWidthInfo(int glyphIndex);
+void fontCalcGlyphPos(fontGlyphPos_s* out, int glyphIndex, u32 flags, float scaleX, float scaleY);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PP2D_HOST_3DS_H */
@@ -0,0 +1,159 @@
+/*  This file is part of pp2d
+>   Copyright (C) 2017/2018 Bernardo Giordano
+>
+>   This program is free software: you can redistribute it and/or modify
+>   it under the terms of the GNU General Public License as published by
+>   the Free Software Foundation, either version 3 of the License, or
+>   (at your option) any later version.
+>
+>   This program is distributed in the hope that it will be useful,
+>   but WITHOUT ANY WARRANTY; without even the implied warranty of
+>   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+>   GNU General Public License for more details.
+>
+>   You should have received a copy of the GNU General Public License
+>   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+>   See LICENSE for information.
+>
+>   https://discord.gg/bGKEyfY
+*/
+
+/**
+ * Plug & Play 2D
+ * @file c3d_trace.h
+ * @brief command stream recorded by the host citro3d/libctru shim
+ */
+
+#ifndef C3D_TRACE_H
+#define C3D_TRACE_H
+
+#include <stdio.h>
+#include <citro3d.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum {
+    TRACE_FRAME_BEGIN,
+    TRACE_FRAME_DRAW_ON,
+    TRACE_FRAME_END,
+    TRACE_FRAME_SPLIT,
+    TRACE_BIND_PROGRAM,
+    TRACE_ATTR_INFO,
+    TRACE_BUF_INFO,
+    TRACE_DEPTH_TEST,
+    TRACE_STENCIL_TEST,
+    TRACE_STENCIL_OP,
+    TRACE_ALPHA_TEST,
+    TRACE_SCISSOR,
+    TRACE_UNIFORM,
+    TRACE_TEX_BIND,
+    TRACE_TEXENV_SRC,
+    TRACE_TEXENV_OP,
+    TRACE_TEXENV_FUNC,
+    TRACE_TEXENV_COLOR,
+    TRACE_TARGET_CLEAR,
+    TRACE_TARGET_OUTPUT,
+    TRACE_DISPLAY_TRANSFER,
+    TRACE_DRAW_ARRAYS,
+    TRACE_DRAW_ELEMENTS,
+    TRACE_TYPE_COUNT
+} trace_type_t;
+
+/**
+ * @brief A single recorded command
+ * @note draw commands copy the vertices they consume to the vertex blob
+ * returned by c3d_trace_vertices, starting at vtxOffset. Indexed draws copy
+ * the range between their lowest and highest index, which is stored in args[3],
+ * and their indices, relative to it, returned by c3d_trace_indices.
+ * Uniforms set through C3D_FVUnifMtx4x4 and C3D_FVUnifSet copy their vectors,
+ * returned by c3d_trace_uniform_values
+ */
+typedef struct {
+    trace_type_t type;
+    u32 frame;
+    u32 args[4];
+    const void* ptr;
+    size_t vtxOffset;
+    size_t vtxBytes;
+    size_t unifOffset;
+    size_t unifVectors;
+    size_t idxOffset;
+} trace_cmd_t;
+
+/// Counters accumulated since the last c3d_trace_reset, whether capturing or not
+typedef struct {
+    u32 counts[TRACE_TYPE_COUNT];
+    u32 frames;
+    u64 vertices;
+    u64 vertexBytes;
+    u64 indices;
+    u64 uniformVectors;
+} trace_stats_t;
+
+/// Clears recorded commands, vertex snapshots and counters
+void c3d_trace_reset(void);
+
+/**
+ * @brief Enables or disables command recording
+ * @param enable true to record commands and vertex snapshots, false to only count them
+ */
+void c3d_trace_capture(bool enable);
+
+/**
+ * @brief Returns the recorded commands
+ * @param count pointer to the number of commands to return
+ * @return pointer to the first command
+ */
+const trace_cmd_t* c3d_trace_commands(size_t* count);
+
+/**
+ * @brief Returns the vertex data copied by recorded draw commands
+ * @param size pointer to the size in bytes to return
+ * @return pointer to the vertex blob
+ */
+const u8* c3d_trace_vertices(size_t* size);
+
+/**
+ * @brief Returns the vectors a recorded uniform command wrote
+ * @param cmd a TRACE_UNIFORM command
+ * @return pointer to the first vector, NULL if the command didn't copy them
+ */
+const C3D_FVec* c3d_trace_uniform_values(const trace_cmd_t* cmd);
+
+/**
+ * @brief Returns the indices a recorded indexed draw read, relative to its lowest one
+ * @param cmd a TRACE_DRAW_ELEMENTS command, whose args[1] is the number of indices
+ * @return pointer to the first index, NULL if the command didn't copy them
+ */
+const u16* c3d_trace_indices(const trace_cmd_t* cmd);
+
+/// Returns the counters accumulated since the last reset
+const trace_stats_t* c3d_trace_stats(void);
+
+/**
+ * @brief Returns the last values written to a uniform
+ * @param type of the shader the uniform belongs to
+ * @param id location of the uniform
+ * @return pointer to the first vector of the uniform
+ */
+const C3D_FVec* c3d_trace_uniform(GPU_SHADER_TYPE type, int id);
+
+/**
+ * @brief Returns a printable name for a command type
+ * @param type of the command
+ */
+const char* c3d_trace_name(trace_type_t type);
+
+/**
+ * @brief Prints the recorded commands
+ * @param out stream to print to
+ */
+void c3d_trace_dump(FILE* out);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* C3D_TRACE_H */
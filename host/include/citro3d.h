@@ -0,0 +1,336 @@
+/*  This file is part of pp2d
+>   Copyright (C) 2017/2018 Bernardo Giordano
+>
+>   This program is free software: you can redistribute it and/or modify
+>   it under the terms of the GNU General Public License as published by
+>   the Free Software Foundation, either version 3 of the License, or
+>   (at your option) any later version.
+>
+>   This program is distributed in the hope that it will be useful,
+>   but WITHOUT ANY WARRANTY; without even the implied warranty of
+>   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+>   GNU General Public License for more details.
+>
+>   You should have received a copy of the GNU General Public License
+>   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+>   See LICENSE for information.
+>
+>   https://discord.gg/bGKEyfY
+*/
+
+/**
+ * Plug & Play 2D
+ * @file citro3d.h
+ * @brief host replacement for the subset of citro3d used by pp2d
+ */
+
+#ifndef PP2D_HOST_CITRO3D_H
+#define PP2D_HOST_CITRO3D_H
+
+#include <math.h>
+#include <3ds.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifndef BIT
+#define BIT(n) (1U<<(n))
+#endif
+
+#define C3D_DEFAULT_CMDBUF_SIZE 0x40000
+#define C3D_FRAME_SYNCDRAW BIT(0)
+#define C3D_FRAME_NONBLOCK BIT(1)
+
+#define C3D_UNSIGNED_BYTE 0
+#define C3D_UNSIGNED_SHORT 1
+
+// gpu enums
+typedef enum {
+    GPU_NEAREST = 0x0,
+    GPU_LINEAR = 0x1
+} GPU_TEXTURE_FILTER_PARAM;
+
+typedef enum {
+    GPU_CLAMP_TO_EDGE = 0x0,
+    GPU_CLAMP_TO_BORDER = 0x1,
+    GPU_REPEAT = 0x2,
+    GPU_MIRRORED_REPEAT = 0x3
+} GPU_TEXTURE_WRAP_PARAM;
+
+#define GPU_TEXTURE_MAG_FILTER(v) (((v)&0x1)<<1)
+#define GPU_TEXTURE_MIN_FILTER(v) (((v)&0x1)<<2)
+#define GPU_TEXTURE_WRAP_S(v)     (((v)&0x3)<<12)
+#define GPU_TEXTURE_WRAP_T(v)     (((v)&0x3)<<8)
+
+typedef enum {
+    GPU_RGBA8 = 0x0,
+    GPU_RGB8 = 0x1,
+    GPU_RGBA5551 = 0x2,
+    GPU_RGB565 = 0x3,
+    GPU_RGBA4 = 0x4,
+    GPU_LA8 = 0x5,
+    GPU_HILO8 = 0x6,
+    GPU_L8 = 0x7,
+    GPU_A8 = 0x8,
+    GPU_LA4 = 0x9,
+    GPU_L4 = 0xA,
+    GPU_A4 = 0xB,
+    GPU_ETC1 = 0xC,
+    GPU_ETC1A4 = 0xD
+} GPU_TEXCOLOR;
+
+typedef enum {
+    GPU_RB_RGBA8 = 0,
+    GPU_RB_RGB8 = 1,
+    GPU_RB_RGBA5551 = 2,
+    GPU_RB_RGB565 = 3,
+    GPU_RB_RGBA4 = 4
+} GPU_COLORBUF;
+
+typedef enum {
+    GPU_RB_DEPTH16 = 0,
+    GPU_RB_DEPTH24 = 2,
+    GPU_RB_DEPTH24_STENCIL8 = 3
+} GPU_DEPTHBUF;
+
+typedef enum {
+    GPU_NEVER = 0,
+    GPU_ALWAYS = 1,
+    GPU_EQUAL = 2,
+    GPU_NOTEQUAL = 3,
+    GPU_LESS = 4,
+    GPU_LEQUAL = 5,
+    GPU_GREATER = 6,
+    GPU_GEQUAL = 7
+} GPU_TESTFUNC;
+
+typedef enum {
+    GPU_WRITE_RED = 0x01,
+    GPU_WRITE_GREEN = 0x02,
+    GPU_WRITE_BLUE = 0x04,
+    GPU_WRITE_ALPHA = 0x08,
+    GPU_WRITE_DEPTH = 0x10,
+    GPU_WRITE_COLOR = 0x0F,
+    GPU_WRITE_ALL = 0x1F
+} GPU_WRITEMASK;
+
+typedef enum {
+    GPU_STENCIL_KEEP = 0,
+    GPU_STENCIL_ZERO = 1,
+    GPU_STENCIL_REPLACE = 2,
+    GPU_STENCIL_INCR = 3,
+    GPU_STENCIL_DECR = 4,
+    GPU_STENCIL_INVERT = 5,
+    GPU_STENCIL_INCR_WRAP = 6,
+    GPU_STENCIL_DECR_WRAP = 7
+} GPU_STENCILOP;
+
+typedef enum {
+    GPU_BYTE = 0,
+    GPU_UNSIGNED_BYTE = 1,
+    GPU_SHORT = 2,
+    GPU_FLOAT = 3
+} GPU_FORMATS;
+
+typedef enum {
+    GPU_PRIMARY_COLOR = 0x00,
+    GPU_FRAGMENT_PRIMARY_COLOR = 0x01,
+    GPU_FRAGMENT_SECONDARY_COLOR = 0x02,
+    GPU_TEXTURE0 = 0x03,
+    GPU_TEXTURE1 = 0x04,
+    GPU_TEXTURE2 = 0x05,
+    GPU_TEXTURE3 = 0x06,
+    GPU_PREVIOUS_BUFFER = 0x0D,
+    GPU_CONSTANT = 0x0E,
+    GPU_PREVIOUS = 0x0F
+} GPU_TEVSRC;
+
+typedef enum {
+    GPU_REPLACE = 0x00,
+    GPU_MODULATE = 0x01,
+    GPU_ADD = 0x02,
+    GPU_ADD_SIGNED = 0x03,
+    GPU_INTERPOLATE = 0x04,
+    GPU_SUBTRACT = 0x05,
+    GPU_DOT3_RGB = 0x06,
+    GPU_MULTIPLY_ADD = 0x08,
+    GPU_ADD_MULTIPLY = 0x09
+} GPU_COMBINEFUNC;
+
+typedef enum {
+    GPU_TRIANGLES = 0x0000,
+    GPU_TRIANGLE_STRIP = 0x0100,
+    GPU_TRIANGLE_FAN = 0x0200,
+    GPU_GEOMETRY_PRIM = 0x0300
+} GPU_Primitive_t;
+
+typedef enum {
+    GPU_SCISSOR_DISABLE = 0,
+    GPU_SCISSOR_INVERT = 1,
+    GPU_SCISSOR_NORMAL = 3
+} GPU_SCISSORMODE;
+
+typedef enum {
+    GPU_VERTEX_SHADER = 0x0,
+    GPU_GEOMETRY_SHADER = 0x1
+} GPU_SHADER_TYPE;
+
+// matrices
+typedef union {
+    struct {
+        float w, z, y, x;
+    };
+    float c[4];
+} C3D_FVec;
+
+typedef union {
+    C3D_FVec r[4];
+    float m[4*4];
+} C3D_Mtx;
+
+void Mtx_Zeros(C3D_Mtx* out);
+void Mtx_OrthoTilt(C3D_Mtx* mtx, float left, float right, float bottom, float top, float near, float far, bool isLeftHanded);
+void Mtx_Scale(C3D_Mtx* mtx, float x, float y, float z);
+void Mtx_Translate(C3D_Mtx* mtx, float x, float y, float z, bool bRightSide);
+
+// shaders
+typedef struct {
+    u32 dummy;
+} DVLE_s;
+
+typedef struct {
+    u32 numDVLE;
+    DVLE_s* DVLE;
+} DVLB_s;
+
+typedef struct {
+    DVLE_s* dvle;
+} shaderInstance_s;
+
+typedef struct {
+    shaderInstance_s* vertexShader;
+    shaderInstance_s* geometryShader;
+} shaderProgram_s;
+
+DVLB_s* DVLB_ParseFile(u32* shbinData, u32 shbinSize);
+void DVLB_Free(DVLB_s* dvlb);
+Result shaderProgramInit(shaderProgram_s* sp);
+Result shaderProgramFree(shaderProgram_s* sp);
+Result shaderProgramSetVsh(shaderProgram_s* sp, DVLE_s* dvle);
+Result shaderProgramSetGsh(shaderProgram_s* sp, DVLE_s* dvle, u8 stride);
+s8 shaderInstanceGetUniformLocation(shaderInstance_s* si, const char* name);
+
+// context
+bool C3D_Init(size_t cmdBufSize);
+void C3D_Fini(void);
+void C3D_BindProgram(shaderProgram_s* program);
+void C3D_DepthTest(bool enable, GPU_TESTFUNC function, GPU_WRITEMASK writemask);
+void C3D_StencilTest(bool enable, GPU_TESTFUNC function, int ref, int inputMask, int writeMask);
+void C3D_StencilOp(GPU_STENCILOP sfail, GPU_STENCILOP dfail, GPU_STENCILOP pass);
+void C3D_AlphaTest(bool enable, GPU_TESTFUNC function, int ref);
+void C3D_SetScissor(GPU_SCISSORMODE mode, u32 left, u32 top, u32 right, u32 bottom);
+C3D_FVec* C3D_FVUnifWritePtr(GPU_SHADER_TYPE type, int id, int size);
+void C3D_FVUnifMtx4x4(GPU_SHADER_TYPE type, int id, const C3D_Mtx* mtx);
+void C3D_FVUnifSet(GPU_SHADER_TYPE type, int id, float x, float y, float z, float w);
+void C3D_DrawArrays(GPU_Primitive_t primitive, int first, int size);
+void C3D_DrawElements(GPU_Primitive_t primitive, int count, int type, const void* indices);
+
+float C3D_GetProcessingTime(void);
+float C3D_GetDrawingTime(void);
+float C3D_GetCmdBufUsage(void);
+
+// attributes and buffers
+typedef struct {
+    int regId;
+    GPU_FORMATS format;
+    int count;
+} C3D_AttrLoader;
+
+typedef struct {
+    int attrCount;
+    C3D_AttrLoader loaders[12];
+} C3D_AttrInfo;
+
+typedef struct {
+    const void* data;
+    ptrdiff_t stride;
+    int attribCount;
+    u64 permutation;
+} C3D_BufCfg;
+
+typedef struct {
+    int bufCount;
+    C3D_BufCfg buffers[12];
+} C3D_BufInfo;
+
+C3D_AttrInfo* C3D_GetAttrInfo(void);
+void AttrInfo_Init(C3D_AttrInfo* info);
+int AttrInfo_AddLoader(C3D_AttrInfo* info, int regId, GPU_FORMATS format, int count);
+
+C3D_BufInfo* C3D_GetBufInfo(void);
+void BufInfo_Init(C3D_BufInfo* info);
+int BufInfo_Add(C3D_BufInfo* info, const void* data, ptrdiff_t stride, int attribCount, u64 permutation);
+
+// textures
+typedef struct {
+    void* data;
+    GPU_TEXCOLOR fmt;
+    size_t size;
+    u16 width;
+    u16 height;
+    u32 param;
+    u32 border;
+    u32 lodParam;
+} C3D_Tex;
+
+bool C3D_TexInit(C3D_Tex* tex, u16 width, u16 height, GPU_TEXCOLOR format);
+void C3D_TexSetFilter(C3D_Tex* tex, GPU_TEXTURE_FILTER_PARAM magFilter, GPU_TEXTURE_FILTER_PARAM minFilter);
+void C3D_TexFlush(C3D_Tex* tex);
+void C3D_TexDelete(C3D_Tex* tex);
+void C3D_TexBind(int unitId, C3D_Tex* tex);
+Result C3D_SafeDisplayTransfer(u32* inadr, u32 indim, u32* outadr, u32 outdim, u32 flags);
+
+// texture combiners
+enum {
+    C3D_RGB = BIT(0),
+    C3D_Alpha = BIT(1),
+    C3D_Both = C3D_RGB | C3D_Alpha
+};
+
+typedef struct {
+    u16 srcRgb, srcAlpha;
+    u32 opAll;
+    u16 funcRgb, funcAlpha;
+    u32 color;
+    u16 scaleRgb, scaleAlpha;
+} C3D_TexEnv;
+
+C3D_TexEnv* C3D_GetTexEnv(int id);
+void C3D_TexEnvSrc(C3D_TexEnv* env, int mode, int s1, int s2, int s3);
+void C3D_TexEnvOp(C3D_TexEnv* env, int mode, int o1, int o2, int o3);
+void C3D_TexEnvFunc(C3D_TexEnv* env, int mode, int param);
+void C3D_TexEnvColor(C3D_TexEnv* env, u32 color);
+
+// render targets
+#define C3D_CLEAR_COLOR BIT(0)
+#define C3D_CLEAR_DEPTH BIT(1)
+#define C3D_CLEAR_ALL (C3D_CLEAR_COLOR | C3D_CLEAR_DEPTH)
+
+typedef struct C3D_RenderTarget_tag C3D_RenderTarget;
+
+C3D_RenderTarget* C3D_RenderTargetCreate(int width, int height, GPU_COLORBUF colorFmt, GPU_DEPTHBUF depthFmt);
+void C3D_RenderTargetDelete(C3D_RenderTarget* target);
+void C3D_RenderTargetSetClear(C3D_RenderTarget* target, u32 clearBits, u32 clearColor, u32 clearDepth);
+void C3D_RenderTargetSetOutput(C3D_RenderTarget* target, gfxScreen_t screen, gfx3dSide_t side, u32 transferFlags);
+
+bool C3D_FrameBegin(u8 flags);
+bool C3D_FrameDrawOn(C3D_RenderTarget* target);
+void C3D_FrameSplit(u8 flags);
+void C3D_FrameEnd(u8 flags);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PP2D_HOST_CITRO3D_H */
@@ -0,0 +1,3 @@
+extern const u8 instance_shbin_end[];
+extern const u8 instance_shbin[];
+extern const u32 instance_shbin_size;
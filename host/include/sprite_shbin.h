@@ -0,0 +1,3 @@
+extern const u8 sprite_shbin_end[];
+extern const u8 sprite_shbin[];
+extern const u32 sprite_shbin_size;
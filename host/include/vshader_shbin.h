@@ -0,0 +1,3 @@
+extern const u8 vshader_shbin_end[];
+extern const u8 vshader_shbin[];
+extern const u32 vshader_shbin_size;
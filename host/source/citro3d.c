@@ -0,0 +1,794 @@
+/*  This file is part of pp2d
+>   Copyright (C) 2017/2018 Bernardo Giordano
+>
+>   This program is free software: you can redistribute it and/or modify
+>   it under the terms of the GNU General Public License as published by
+>   the Free Software Foundation, either version 3 of the License, or
+>   (at your option) any later version.
+>
+>   This program is distributed in the hope that it will be useful,
+>   but WITHOUT ANY WARRANTY; without even the implied warranty of
+>   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+>   GNU General Public License for more details.
+>
+>   You should have received a copy of the GNU General Public License
+>   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+>   See LICENSE for information.
+>
+>   https://discord.gg/bGKEyfY
+*/
+
+/**
+ * Plug & Play 2D
+ * @file citro3d.c
+ * @brief recording host implementation of the citro3d subset used by pp2d
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "c3d_trace.h"
+
+#define MAX_UNIFORM_NAMES 32
+#define MAX_UNIFORM_VECTORS 96
+
+struct C3D_RenderTarget_tag {
+    int width;
+    int height;
+    u32 clearBits;
+    u32 clearColor;
+    u32 clearDepth;
+    bool linked;
+    bool used;
+    gfxScreen_t screen;
+    gfx3dSide_t side;
+};
+
+// shader blobs referenced by pp2d.h
+const u8 vshader_shbin[4];
+const u8 vshader_shbin_end[1];
+const u32 vshader_shbin_size = sizeof(vshader_shbin);
+const u8 sprite_shbin[4];
+const u8 sprite_shbin_end[1];
+const u32 sprite_shbin_size = sizeof(sprite_shbin);
+const u8 instance_shbin[4];
+const u8 instance_shbin_end[1];
+const u32 instance_shbin_size = sizeof(instance_shbin);
+
+static struct {
+    trace_cmd_t* cmds;
+    size_t count;
+    size_t capacity;
+    u8* vertices;
+    size_t vtxSize;
+    size_t vtxCapacity;
+    C3D_FVec* unifs;
+    size_t unifCount;
+    size_t unifCapacity;
+    u16* idxs;
+    size_t idxCount;
+    size_t idxCapacity;
+    trace_stats_t stats;
+    bool capture;
+} trace = { .capture = true };
+
+static C3D_AttrInfo attrInfo;
+static C3D_BufInfo bufInfo;
+static C3D_TexEnv texEnv[6];
+static bool inFrame = false;
+static C3D_RenderTarget* linkedTargets[3];
+static const char* uniformNames[MAX_UNIFORM_NAMES];
+static int uniformCount = 0;
+// uniform names are 4 locations apart, each one gets registers of its own so arrays never overlap
+static C3D_FVec uniforms[2][MAX_UNIFORM_NAMES][MAX_UNIFORM_VECTORS];
+
+static const char* traceNames[TRACE_TYPE_COUNT] = {
+    "FrameBegin",
+    "FrameDrawOn",
+    "FrameEnd",
+    "FrameSplit",
+    "BindProgram",
+    "AttrInfo",
+    "BufInfo",
+    "DepthTest",
+    "StencilTest",
+    "StencilOp",
+    "AlphaTest",
+    "Scissor",
+    "Uniform",
+    "TexBind",
+    "TexEnvSrc",
+    "TexEnvOp",
+    "TexEnvFunc",
+    "TexEnvColor",
+    "TargetClear",
+    "TargetOutput",
+    "DisplayTransfer",
+    "DrawArrays",
+    "DrawElements",
+};
+
+static trace_cmd_t* trace_push(trace_type_t type, const void* ptr, u32 a0, u32 a1, u32 a2, u32 a3)
+{
+    trace.stats.counts[type]++;
+    if (!trace.capture)
+    {
+        return NULL;
+    }
+
+    if (trace.count == trace.capacity)
+    {
+        trace.capacity = trace.capacity ? trace.capacity*2 : 1024;
+        trace.cmds = realloc(trace.cmds, trace.capacity*sizeof(trace_cmd_t));
+    }
+
+    trace_cmd_t* cmd = &trace.cmds[trace.count++];
+    cmd->type = type;
+    cmd->frame = trace.stats.frames;
+    cmd->args[0] = a0;
+    cmd->args[1] = a1;
+    cmd->args[2] = a2;
+    cmd->args[3] = a3;
+    cmd->ptr = ptr;
+    cmd->vtxOffset = 0;
+    cmd->vtxBytes = 0;
+    cmd->unifOffset = 0;
+    cmd->unifVectors = 0;
+    cmd->idxOffset = SIZE_MAX;
+    return cmd;
+}
+
+static void trace_snapshot(trace_cmd_t* cmd, const void* data, size_t size)
+{
+    if (cmd == NULL || size == 0)
+    {
+        return;
+    }
+
+    if (trace.vtxSize + size > trace.vtxCapacity)
+    {
+        while (trace.vtxSize + size > trace.vtxCapacity)
+        {
+            trace.vtxCapacity = trace.vtxCapacity ? trace.vtxCapacity*2 : 0x10000;
+        }
+        trace.vertices = realloc(trace.vertices, trace.vtxCapacity);
+    }
+
+    cmd->vtxOffset = trace.vtxSize;
+    cmd->vtxBytes = size;
+    memcpy(trace.vertices + trace.vtxSize, data, size);
+    trace.vtxSize += size;
+}
+
+static void trace_snapshot_uniform(trace_cmd_t* cmd, const C3D_FVec* vectors, size_t count)
+{
+    if (cmd == NULL)
+    {
+        return;
+    }
+
+    if (trace.unifCount + count > trace.unifCapacity)
+    {
+        while (trace.unifCount + count > trace.unifCapacity)
+        {
+            trace.unifCapacity = trace.unifCapacity ? trace.unifCapacity*2 : 256;
+        }
+        trace.unifs = realloc(trace.unifs, trace.unifCapacity*sizeof(C3D_FVec));
+    }
+
+    cmd->unifOffset = trace.unifCount;
+    cmd->unifVectors = count;
+    memcpy(trace.unifs + trace.unifCount, vectors, count*sizeof(C3D_FVec));
+    trace.unifCount += count;
+}
+
+static void trace_snapshot_indices(trace_cmd_t* cmd, const void* indices, int count, int type, u32 first)
+{
+    if (cmd == NULL)
+    {
+        return;
+    }
+
+    if (trace.idxCount + count > trace.idxCapacity)
+    {
+        while (trace.idxCount + count > trace.idxCapacity)
+        {
+            trace.idxCapacity = trace.idxCapacity ? trace.idxCapacity*2 : 0x1000;
+        }
+        trace.idxs = realloc(trace.idxs, trace.idxCapacity*sizeof(u16));
+    }
+
+    cmd->idxOffset = trace.idxCount;
+    for (int i = 0; i < count; i++)
+    {
+        const u32 idx = type == C3D_UNSIGNED_SHORT ? ((const u16*)indices)[i] : ((const u8*)indices)[i];
+        trace.idxs[trace.idxCount++] = idx - first;
+    }
+}
+
+void c3d_trace_reset(void)
+{
+    trace.count = 0;
+    trace.vtxSize = 0;
+    trace.unifCount = 0;
+    trace.idxCount = 0;
+    memset(&trace.stats, 0, sizeof(trace.stats));
+}
+
+void c3d_trace_capture(bool enable)
+{
+    trace.capture = enable;
+}
+
+const trace_cmd_t* c3d_trace_commands(size_t* count)
+{
+    *count = trace.count;
+    return trace.cmds;
+}
+
+const u8* c3d_trace_vertices(size_t* size)
+{
+    *size = trace.vtxSize;
+    return trace.vertices;
+}
+
+const C3D_FVec* c3d_trace_uniform_values(const trace_cmd_t* cmd)
+{
+    return cmd->unifVectors ? trace.unifs + cmd->unifOffset : NULL;
+}
+
+const u16* c3d_trace_indices(const trace_cmd_t* cmd)
+{
+    return cmd->idxOffset != SIZE_MAX ? trace.idxs + cmd->idxOffset : NULL;
+}
+
+const trace_stats_t* c3d_trace_stats(void)
+{
+    return &trace.stats;
+}
+
+const C3D_FVec* c3d_trace_uniform(GPU_SHADER_TYPE type, int id)
+{
+    return &uniforms[type][id/4][id%4];
+}
+
+const char* c3d_trace_name(trace_type_t type)
+{
+    return type < TRACE_TYPE_COUNT ? traceNames[type] : "?";
+}
+
+void c3d_trace_dump(FILE* out)
+{
+    for (size_t i = 0; i < trace.count; i++)
+    {
+        const trace_cmd_t* cmd = &trace.cmds[i];
+        fprintf(out, "%6u %-12s %p %08x %08x %08x %08x", cmd->frame, c3d_trace_name(cmd->type), cmd->ptr,
+            cmd->args[0], cmd->args[1], cmd->args[2], cmd->args[3]);
+        if (cmd->vtxBytes)
+        {
+            fprintf(out, " vtx@%zu+%zu", cmd->vtxOffset, cmd->vtxBytes);
+        }
+        fputc('\n', out);
+    }
+}
+
+void Mtx_Zeros(C3D_Mtx* out)
+{
+    memset(out, 0, sizeof(*out));
+}
+
+void Mtx_OrthoTilt(C3D_Mtx* mtx, float left, float right, float bottom, float top, float near, float far, bool isLeftHanded)
+{
+    Mtx_Zeros(mtx);
+
+    // standard orthogonal projection with PICA's [-1,0] depth range, rotated by 90 degrees
+    mtx->r[0].y = 2.0f / (top - bottom);
+    mtx->r[0].w = (bottom + top) / (bottom - top);
+    mtx->r[1].x = 2.0f / (left - right);
+    mtx->r[1].w = (left + right) / (right - left);
+    mtx->r[2].z = isLeftHanded ? 1.0f / (far - near) : 1.0f / (near - far);
+    mtx->r[2].w = 0.5f*(near + far) / (near - far) - 0.5f;
+    mtx->r[3].w = 1.0f;
+}
+
+void Mtx_Scale(C3D_Mtx* mtx, float x, float y, float z)
+{
+    // mtx * scale: each column is scaled
+    for (int i = 0; i < 4; i++)
+    {
+        mtx->r[i].x *= x;
+        mtx->r[i].y *= y;
+        mtx->r[i].z *= z;
+    }
+}
+
+void Mtx_Translate(C3D_Mtx* mtx, float x, float y, float z, bool bRightSide)
+{
+    for (int i = 0; i < 4; i++)
+    {
+        if (bRightSide)
+        {
+            // mtx * translation: the other columns are added to the last one
+            mtx->r[i].w += mtx->r[i].x*x + mtx->r[i].y*y + mtx->r[i].z*z;
+        }
+        else
+        {
+            // translation * mtx: the last row is added to the other ones
+            mtx->r[0].c[i] += x*mtx->r[3].c[i];
+            mtx->r[1].c[i] += y*mtx->r[3].c[i];
+            mtx->r[2].c[i] += z*mtx->r[3].c[i];
+        }
+    }
+}
+
+DVLB_s* DVLB_ParseFile(u32* shbinData, u32 shbinSize)
+{
+    (void)shbinData;
+    (void)shbinSize;
+    DVLB_s* dvlb = calloc(1, sizeof(DVLB_s));
+    dvlb->numDVLE = 4;
+    dvlb->DVLE = calloc(dvlb->numDVLE, sizeof(DVLE_s));
+    return dvlb;
+}
+
+void DVLB_Free(DVLB_s* dvlb)
+{
+    if (dvlb)
+    {
+        free(dvlb->DVLE);
+        free(dvlb);
+    }
+}
+
+Result shaderProgramInit(shaderProgram_s* sp)
+{
+    memset(sp, 0, sizeof(*sp));
+    return 0;
+}
+
+Result shaderProgramFree(shaderProgram_s* sp)
+{
+    free(sp->vertexShader);
+    free(sp->geometryShader);
+    memset(sp, 0, sizeof(*sp));
+    return 0;
+}
+
+Result shaderProgramSetVsh(shaderProgram_s* sp, DVLE_s* dvle)
+{
+    free(sp->vertexShader);
+    sp->vertexShader = calloc(1, sizeof(shaderInstance_s));
+    sp->vertexShader->dvle = dvle;
+    return 0;
+}
+
+Result shaderProgramSetGsh(shaderProgram_s* sp, DVLE_s* dvle, u8 stride)
+{
+    (void)stride;
+    free(sp->geometryShader);
+    sp->geometryShader = calloc(1, sizeof(shaderInstance_s));
+    sp->geometryShader->dvle = dvle;
+    return 0;
+}
+
+s8 shaderInstanceGetUniformLocation(shaderInstance_s* si, const char* name)
+{
+    (void)si;
+    for (int i = 0; i < uniformCount; i++)
+    {
+        if (strcmp(uniformNames[i], name) == 0)
+        {
+            return i*4;
+        }
+    }
+
+    if (uniformCount == MAX_UNIFORM_NAMES)
+    {
+        return -1;
+    }
+    uniformNames[uniformCount] = name;
+    return (uniformCount++)*4;
+}
+
+bool C3D_Init(size_t cmdBufSize)
+{
+    (void)cmdBufSize;
+    memset(&attrInfo, 0, sizeof(attrInfo));
+    memset(&bufInfo, 0, sizeof(bufInfo));
+    memset(texEnv, 0, sizeof(texEnv));
+    inFrame = false;
+    return true;
+}
+
+void C3D_Fini(void)
+{
+    free(trace.cmds);
+    free(trace.vertices);
+    free(trace.unifs);
+    free(trace.idxs);
+    trace.cmds = NULL;
+    trace.vertices = NULL;
+    trace.unifs = NULL;
+    trace.idxs = NULL;
+    trace.capacity = 0;
+    trace.vtxCapacity = 0;
+    trace.unifCapacity = 0;
+    trace.idxCapacity = 0;
+    c3d_trace_reset();
+}
+
+void C3D_BindProgram(shaderProgram_s* program)
+{
+    trace_push(TRACE_BIND_PROGRAM, program, 0, 0, 0, 0);
+}
+
+void C3D_DepthTest(bool enable, GPU_TESTFUNC function, GPU_WRITEMASK writemask)
+{
+    trace_push(TRACE_DEPTH_TEST, NULL, enable, function, writemask, 0);
+}
+
+void C3D_StencilTest(bool enable, GPU_TESTFUNC function, int ref, int inputMask, int writeMask)
+{
+    trace_push(TRACE_STENCIL_TEST, NULL, enable, function, ref, inputMask | writeMask << 8);
+}
+
+void C3D_StencilOp(GPU_STENCILOP sfail, GPU_STENCILOP dfail, GPU_STENCILOP pass)
+{
+    trace_push(TRACE_STENCIL_OP, NULL, sfail, dfail, pass, 0);
+}
+
+void C3D_AlphaTest(bool enable, GPU_TESTFUNC function, int ref)
+{
+    trace_push(TRACE_ALPHA_TEST, NULL, enable, function, ref, 0);
+}
+
+C3D_FVec* C3D_FVUnifWritePtr(GPU_SHADER_TYPE type, int id, int size)
+{
+    trace_push(TRACE_UNIFORM, NULL, type, id, size, 0);
+    trace.stats.uniformVectors += size;
+    return &uniforms[type][id/4][id%4];
+}
+
+void C3D_SetScissor(GPU_SCISSORMODE mode, u32 left, u32 top, u32 right, u32 bottom)
+{
+    trace_push(TRACE_SCISSOR, NULL, mode, left | top << 16, right | bottom << 16, 0);
+}
+
+void C3D_FVUnifMtx4x4(GPU_SHADER_TYPE type, int id, const C3D_Mtx* mtx)
+{
+    trace_cmd_t* cmd = trace_push(TRACE_UNIFORM, mtx, type, id, 4, 0);
+    trace.stats.uniformVectors += 4;
+    memcpy(&uniforms[type][id/4][id%4], mtx->r, sizeof(mtx->r));
+    trace_snapshot_uniform(cmd, mtx->r, 4);
+}
+
+void C3D_FVUnifSet(GPU_SHADER_TYPE type, int id, float x, float y, float z, float w)
+{
+    trace_cmd_t* cmd = trace_push(TRACE_UNIFORM, NULL, type, id, 1, 0);
+    trace.stats.uniformVectors++;
+    C3D_FVec* vec = &uniforms[type][id/4][id%4];
+    vec->x = x;
+    vec->y = y;
+    vec->z = z;
+    vec->w = w;
+    trace_snapshot_uniform(cmd, vec, 1);
+}
+
+void C3D_DrawArrays(GPU_Primitive_t primitive, int first, int size)
+{
+    trace_cmd_t* cmd = trace_push(TRACE_DRAW_ARRAYS, bufInfo.buffers[0].data, primitive, first, size, 0);
+    trace.stats.vertices += size;
+
+    for (int i = 0; i < bufInfo.bufCount; i++)
+    {
+        const C3D_BufCfg* buf = &bufInfo.buffers[i];
+        trace.stats.vertexBytes += (u64)size*buf->stride;
+        if (i == 0 && buf->data)
+        {
+            trace_snapshot(cmd, (const u8*)buf->data + first*buf->stride, size*buf->stride);
+        }
+    }
+}
+
+void C3D_DrawElements(GPU_Primitive_t primitive, int count, int type, const void* indices)
+{
+    // the vertex loader only fetches the vertices the indices reference, which may be scattered.
+    // Each draw marks them with its own number, so the marks never need clearing
+    static u32 referenced[0x10000];
+    static u32 draw;
+    if (++draw == 0)
+    {
+        memset(referenced, 0, sizeof(referenced));
+        draw = 1;
+    }
+    u32 first = ~0U;
+    u32 last = 0;
+    u32 unique = 0;
+    for (int i = 0; i < count; i++)
+    {
+        u32 idx = type == C3D_UNSIGNED_SHORT ? ((const u16*)indices)[i] : ((const u8*)indices)[i];
+        first = idx < first ? idx : first;
+        last = idx > last ? idx : last;
+        unique += referenced[idx] != draw;
+        referenced[idx] = draw;
+    }
+
+    const int size = count ? last - first + 1 : 0;
+    trace_cmd_t* cmd = trace_push(TRACE_DRAW_ELEMENTS, bufInfo.buffers[0].data, primitive, count, type, count ? first : 0);
+    trace.stats.vertices += unique;
+    trace.stats.indices += count;
+    trace_snapshot_indices(cmd, indices, count, type, count ? first : 0);
+
+    for (int i = 0; i < bufInfo.bufCount; i++)
+    {
+        const C3D_BufCfg* buf = &bufInfo.buffers[i];
+        trace.stats.vertexBytes += (u64)unique*buf->stride;
+        if (i == 0 && buf->data)
+        {
+            trace_snapshot(cmd, (const u8*)buf->data + first*buf->stride, size*buf->stride);
+        }
+    }
+}
+
+float C3D_GetProcessingTime(void)
+{
+    return 0.0f;
+}
+
+float C3D_GetDrawingTime(void)
+{
+    return 0.0f;
+}
+
+float C3D_GetCmdBufUsage(void)
+{
+    return 0.0f;
+}
+
+C3D_AttrInfo* C3D_GetAttrInfo(void)
+{
+    return &attrInfo;
+}
+
+void AttrInfo_Init(C3D_AttrInfo* info)
+{
+    memset(info, 0, sizeof(*info));
+    trace_push(TRACE_ATTR_INFO, info, 0, 0, 0, 0);
+}
+
+int AttrInfo_AddLoader(C3D_AttrInfo* info, int regId, GPU_FORMATS format, int count)
+{
+    if (info->attrCount == 12)
+    {
+        return -1;
+    }
+
+    C3D_AttrLoader* loader = &info->loaders[info->attrCount];
+    loader->regId = regId;
+    loader->format = format;
+    loader->count = count;
+    trace_push(TRACE_ATTR_INFO, info, regId, format, count, 0);
+    return info->attrCount++;
+}
+
+C3D_BufInfo* C3D_GetBufInfo(void)
+{
+    return &bufInfo;
+}
+
+void BufInfo_Init(C3D_BufInfo* info)
+{
+    memset(info, 0, sizeof(*info));
+    trace_push(TRACE_BUF_INFO, info, 0, 0, 0, 0);
+}
+
+int BufInfo_Add(C3D_BufInfo* info, const void* data, ptrdiff_t stride, int attribCount, u64 permutation)
+{
+    if (info->bufCount == 12)
+    {
+        return -1;
+    }
+
+    C3D_BufCfg* buf = &info->buffers[info->bufCount];
+    buf->data = data;
+    buf->stride = stride;
+    buf->attribCount = attribCount;
+    buf->permutation = permutation;
+    trace_push(TRACE_BUF_INFO, data, (u32)stride, attribCount, (u32)permutation, 0);
+    return info->bufCount++;
+}
+
+bool C3D_TexInit(C3D_Tex* tex, u16 width, u16 height, GPU_TEXCOLOR format)
+{
+    memset(tex, 0, sizeof(*tex));
+    tex->size = (size_t)width*height*4;
+    tex->data = linearAlloc(tex->size);
+    tex->fmt = format;
+    tex->width = width;
+    tex->height = height;
+    return tex->data != NULL;
+}
+
+void C3D_TexSetFilter(C3D_Tex* tex, GPU_TEXTURE_FILTER_PARAM magFilter, GPU_TEXTURE_FILTER_PARAM minFilter)
+{
+    tex->param &= ~(GPU_TEXTURE_MAG_FILTER(GPU_LINEAR) | GPU_TEXTURE_MIN_FILTER(GPU_LINEAR));
+    tex->param |= GPU_TEXTURE_MAG_FILTER(magFilter) | GPU_TEXTURE_MIN_FILTER(minFilter);
+}
+
+void C3D_TexFlush(C3D_Tex* tex)
+{
+    (void)tex;
+}
+
+void C3D_TexDelete(C3D_Tex* tex)
+{
+    linearFree(tex->data);
+    tex->data = NULL;
+}
+
+void C3D_TexBind(int unitId, C3D_Tex* tex)
+{
+    trace_push(TRACE_TEX_BIND, tex, unitId, 0, 0, 0);
+}
+
+Result C3D_SafeDisplayTransfer(u32* inadr, u32 indim, u32* outadr, u32 outdim, u32 flags)
+{
+    (void)outdim;
+    (void)flags;
+    memcpy(outadr, inadr, (size_t)(indim & 0xFFFF)*(indim >> 16)*4);
+    return 0;
+}
+
+C3D_TexEnv* C3D_GetTexEnv(int id)
+{
+    return &texEnv[id];
+}
+
+void C3D_TexEnvSrc(C3D_TexEnv* env, int mode, int s1, int s2, int s3)
+{
+    int param = s1 | (s2 << 4) | (s3 << 8);
+    if (mode & C3D_RGB)
+    {
+        env->srcRgb = param;
+    }
+    if (mode & C3D_Alpha)
+    {
+        env->srcAlpha = param;
+    }
+    trace_push(TRACE_TEXENV_SRC, env, mode, param, 0, 0);
+}
+
+void C3D_TexEnvOp(C3D_TexEnv* env, int mode, int o1, int o2, int o3)
+{
+    int param = o1 | (o2 << 4) | (o3 << 8);
+    if (mode & C3D_RGB)
+    {
+        env->opAll = (env->opAll & ~0xFFF) | param;
+    }
+    if (mode & C3D_Alpha)
+    {
+        env->opAll = (env->opAll & 0xFFF) | (param << 12);
+    }
+    trace_push(TRACE_TEXENV_OP, env, mode, param, 0, 0);
+}
+
+void C3D_TexEnvFunc(C3D_TexEnv* env, int mode, int param)
+{
+    if (mode & C3D_RGB)
+    {
+        env->funcRgb = param;
+    }
+    if (mode & C3D_Alpha)
+    {
+        env->funcAlpha = param;
+    }
+    trace_push(TRACE_TEXENV_FUNC, env, mode, param, 0, 0);
+}
+
+void C3D_TexEnvColor(C3D_TexEnv* env, u32 color)
+{
+    env->color = color;
+    trace_push(TRACE_TEXENV_COLOR, env, color, 0, 0, 0);
+}
+
+C3D_RenderTarget* C3D_RenderTargetCreate(int width, int height, GPU_COLORBUF colorFmt, GPU_DEPTHBUF depthFmt)
+{
+    (void)colorFmt;
+    (void)depthFmt;
+    C3D_RenderTarget* target = calloc(1, sizeof(C3D_RenderTarget));
+    target->width = width;
+    target->height = height;
+    return target;
+}
+
+void C3D_RenderTargetDelete(C3D_RenderTarget* target)
+{
+    for (int id = 0; id < 3; id++)
+    {
+        if (linkedTargets[id] == target)
+        {
+            linkedTargets[id] = NULL;
+        }
+    }
+    free(target);
+}
+
+void C3D_RenderTargetSetClear(C3D_RenderTarget* target, u32 clearBits, u32 clearColor, u32 clearDepth)
+{
+    target->clearBits = clearBits;
+    target->clearColor = clearColor;
+    target->clearDepth = clearDepth;
+    trace_push(TRACE_TARGET_CLEAR, target, clearBits, clearColor, clearDepth, 0);
+}
+
+void C3D_RenderTargetSetOutput(C3D_RenderTarget* target, gfxScreen_t screen, gfx3dSide_t side, u32 transferFlags)
+{
+    // top left, top right and bottom screens each show one target at most
+    const int id = screen == GFX_BOTTOM ? 2 : (side == GFX_RIGHT ? 1 : 0);
+    if (linkedTargets[id])
+    {
+        linkedTargets[id]->linked = false;
+    }
+    linkedTargets[id] = target;
+    if (target)
+    {
+        target->linked = true;
+        target->used = false;
+        target->screen = screen;
+        target->side = side;
+    }
+    trace_push(TRACE_TARGET_OUTPUT, target, screen, side, transferFlags, 0);
+}
+
+bool C3D_FrameBegin(u8 flags)
+{
+    if (inFrame)
+    {
+        return false;
+    }
+
+    inFrame = true;
+    trace_push(TRACE_FRAME_BEGIN, NULL, flags, 0, 0, 0);
+    return true;
+}
+
+bool C3D_FrameDrawOn(C3D_RenderTarget* target)
+{
+    if (!inFrame)
+    {
+        return false;
+    }
+
+    target->used = true;
+    trace_push(TRACE_FRAME_DRAW_ON, target, target->width, target->height, 0, 0);
+    return true;
+}
+
+void C3D_FrameSplit(u8 flags)
+{
+    if (inFrame)
+    {
+        trace_push(TRACE_FRAME_SPLIT, NULL, flags, 0, 0, 0);
+    }
+}
+
+void C3D_FrameEnd(u8 flags)
+{
+    if (!inFrame)
+    {
+        return;
+    }
+
+    trace_push(TRACE_FRAME_END, NULL, flags, 0, 0, 0);
+
+    // like citro3D, only linked targets drawn on this frame are transferred to the screen
+    for (int id = 0; id < 3; id++)
+    {
+        if (linkedTargets[id] && linkedTargets[id]->used)
+        {
+            linkedTargets[id]->used = false;
+            trace_push(TRACE_DISPLAY_TRANSFER, linkedTargets[id], linkedTargets[id]->screen, linkedTargets[id]->side, 0, 0);
+        }
+    }
+    trace.stats.frames++;
+    inFrame = false;
+}
@@ -0,0 +1,227 @@
+/*  This file is part of pp2d
+>   Copyright (C) 2017/2018 Bernardo Giordano
+>
+>   This program is free software: you can redistribute it and/or modify
+>   it under the terms of the GNU General Public License as published by
+>   the Free Software Foundation, either version 3 of the License, or
+>   (at your option) any later version.
+>
+>   This program is distributed in the hope that it will be useful,
+>   but WITHOUT ANY WARRANTY; without even the implied warranty of
+>   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+>   GNU General Public License for more details.
+>
+>   You should have received a copy of the GNU General Public License
+>   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+>   See LICENSE for information.
+>
+>   https://discord.gg/bGKEyfY
+*/
+
+/**
+ * Plug & Play 2D
+ * @file ctru.c
+ * @brief host implementation of the libctru subset used by pp2d
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <3ds.h>
+
+// synthetic system font: 24x30 cells, 10x4 cells per 256x128 A4 sheet
+#define FONT_SHEETS 128
+#define FONT_ROWS 10
+#define FONT_LINES 4
+#define FONT_GLYPHS_PER_SHEET (FONT_ROWS*FONT_LINES)
+#define FONT_GLYPHS (FONT_SHEETS*FONT_GLYPHS_PER_SHEET)
+#define FONT_ASCII_GLYPHS 95
+
+static TGLP_s fontGlyphInfo;
+static FINF_s fontInfo;
+static charWidthInfo_s fontWidths[FONT_GLYPHS];
+static bool fontMapped = false;
+
+void gfxInitDefault(void)
+{
+}
+
+void gfxExit(void)
+{
+}
+
+void gfxSet3D(bool enable)
+{
+    (void)enable;
+}
+
+void gfxSetDoubleBuffering(gfxScreen_t screen, bool doubleBuffering)
+{
+    (void)screen;
+    (void)doubleBuffering;
+}
+
+Result GSPGPU_FlushDataCache(const void* adr, u32 size)
+{
+    (void)adr;
+    (void)size;
+    return 0;
+}
+
+void gspWaitForPPF(void)
+{
+}
+
+void* linearAlloc(size_t size)
+{
+    void* mem = NULL;
+    if (posix_memalign(&mem, 0x80, size ? size : 1) != 0)
+    {
+        return NULL;
+    }
+    return mem;
+}
+
+void linearFree(void* mem)
+{
+    free(mem);
+}
+
+ssize_t decode_utf8(uint32_t* out, const uint8_t* in)
+{
+    if (in[0] < 0x80)
+    {
+        *out = in[0];
+        return 1;
+    }
+
+    int units;
+    uint32_t code;
+    if ((in[0] & 0xE0) == 0xC0)
+    {
+        units = 2;
+        code = in[0] & 0x1F;
+    }
+    else if ((in[0] & 0xF0) == 0xE0)
+    {
+        units = 3;
+        code = in[0] & 0x0F;
+    }
+    else if ((in[0] & 0xF8) == 0xF0)
+    {
+        units = 4;
+        code = in[0] & 0x07;
+    }
+    else
+    {
+        return -1;
+    }
+
+    for (int i = 1; i < units; i++)
+    {
+        if ((in[i] & 0xC0) != 0x80)
+        {
+            return -1;
+        }
+        code = (code << 6) | (in[i] & 0x3F);
+    }
+
+    *out = code;
+    return units;
+}
+
+Result fontEnsureMapped(void)
+{
+    if (fontMapped)
+    {
+        return 0;
+    }
+
+    fontGlyphInfo.cellWidth = 24;
+    fontGlyphInfo.cellHeight = 30;
+    fontGlyphInfo.baselinePos = 24;
+    fontGlyphInfo.maxCharWidth = 24;
+    fontGlyphInfo.sheetWidth = 256;
+    fontGlyphInfo.sheetHeight = 128;
+    fontGlyphInfo.sheetFmt = 0xB; // GPU_A4
+    fontGlyphInfo.sheetSize = fontGlyphInfo.sheetWidth*fontGlyphInfo.sheetHeight/2;
+    fontGlyphInfo.nSheets = FONT_SHEETS;
+    fontGlyphInfo.nRows = FONT_ROWS;
+    fontGlyphInfo.nLines = FONT_LINES;
+    fontGlyphInfo.sheetData = calloc(FONT_SHEETS, fontGlyphInfo.sheetSize);
+
+    fontInfo.lineFeed = 30;
+    fontInfo.defaultWidth.glyphWidth = 20;
+    fontInfo.defaultWidth.charWidth = 20;
+    fontInfo.tglp = &fontGlyphInfo;
+
+    // latin glyphs are narrow and vary in width, everything else is full width
+    for (int i = 0; i < FONT_GLYPHS; i++)
+    {
+        fontWidths[i].left = 0;
+        fontWidths[i].glyphWidth = i < FONT_ASCII_GLYPHS ? 8 + i % 5 : 20;
+        fontWidths[i].charWidth = fontWidths[i].glyphWidth + 1;
+    }
+
+    fontMapped = true;
+    return 0;
+}
+
+FINF_s* fontGetInfo(void)
+{
+    return &fontInfo;
+}
+
+TGLP_s* fontGetGlyphInfo(void)
+{
+    return &fontGlyphInfo;
+}
+
+void* fontGetGlyphSheetTex(int sheetIndex)
+{
+    return fontGlyphInfo.sheetData + sheetIndex*fontGlyphInfo.sheetSize;
+}
+
+int fontGlyphIndexFromCodePoint(u32 codePoint)
+{
+    if (codePoint >= 0x20 && codePoint < 0x7F)
+    {
+        return codePoint - 0x20;
+    }
+    return FONT_ASCII_GLYPHS + codePoint % (FONT_GLYPHS - FONT_ASCII_GLYPHS);
+}
+
+charWidthInfo_s* fontGetCharWidthInfo(int glyphIndex)
+{
+    return &fontWidths[glyphIndex];
+}
+
+void fontCalcGlyphPos(fontGlyphPos_s* out, int glyphIndex, u32 flags, float scaleX, float scaleY)
+{
+    const TGLP_s* tglp = &fontGlyphInfo;
+    const charWidthInfo_s* cwi = &fontWidths[glyphIndex];
+    int glyphInSheet = glyphIndex % FONT_GLYPHS_PER_SHEET;
+    int lineId = glyphInSheet / tglp->nRows;
+    int rowId = glyphInSheet % tglp->nRows;
+
+    out->sheetIndex = glyphIndex / FONT_GLYPHS_PER_SHEET;
+    out->xOffset = scaleX*cwi->left;
+    out->xAdvance = scaleX*cwi->charWidth;
+    out->width = scaleX*cwi->glyphWidth;
+
+    float tx = (float)(rowId*(tglp->cellWidth + 1) + 1) / tglp->sheetWidth;
+    float ty = 1.0f - (float)((lineId + 1)*(tglp->cellHeight + 1) + 1) / tglp->sheetHeight;
+    float tw = (float)cwi->glyphWidth / tglp->sheetWidth;
+    float th = (float)tglp->cellHeight / tglp->sheetHeight;
+    out->texcoord.left = tx;
+    out->texcoord.top = ty + th;
+    out->texcoord.right = tx + tw;
+    out->texcoord.bottom = ty;
+
+    if (flags & GLYPH_POS_CALC_VTXCOORD)
+    {
+        out->vtxcoord.left = out->xOffset;
+        out->vtxcoord.top = 0.0f;
+        out->vtxcoord.right = out->xOffset + out->width;
+        out->vtxcoord.bottom = scaleY*tglp->cellHeight;
+    }
+}
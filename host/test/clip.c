@@ -0,0 +1,166 @@
+/*  This file is part of pp2d
+>   Copyright (C) 2017/2018 Bernardo Giordano
+>
+>   This program is free software: you can redistribute it and/or modify
+>   it under the terms of the GNU General Public License as published by
+>   the Free Software Foundation, either version 3 of the License, or
+>   (at your option) any later version.
+>
+>   This program is distributed in the hope that it will be useful,
+>   but WITHOUT ANY WARRANTY; without even the implied warranty of
+>   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+>   GNU General Public License for more details.
+>
+>   You should have received a copy of the GNU General Public License
+>   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+>   See LICENSE for information.
+>
+>   https://discord.gg/bGKEyfY
+*/
+
+/**
+ * Plug & Play 2D
+ * @file clip.c
+ * @brief clip rects reaching past the screen and past 16 bit coordinates, and clip rects on the bottom screen around
+ * a static layer and a tile map in the opaque pass, checked through the scissor they set
+ */
+
+#include <limits.h>
+#include "pp2d.h"
+#include "c3d_trace.h"
+
+typedef struct {
+    const char* name;
+    // the outer rect, when width isn't 0, and the rect pushed inside it
+    int outer[4];
+    int inner[4];
+    // what the screen shows of a rectangle covering it, nothing when right <= left or bottom <= top
+    int visible[4];
+} clip_case_t;
+
+static const clip_case_t cases[] = {
+    { "oversized",               { 0 },               { 10, 20, INT_MAX, INT_MAX },                 { 10, 20, PP2D_SCREEN_TOP_WIDTH, PP2D_SCREEN_HEIGHT } },
+    { "far up and left",         { 0 },               { -100000, -100000, 100050, 100060 },         { 0, 0, 50, 60 } },
+    { "far right, nested",       { 0, 0, 300, 200 },  { 40000, 0, 100, 100 },                       { 0 } },
+    { "far down, nested",        { 0, 0, 300, 200 },  { 0, 70000, 100, 100 },                       { 0 } },
+    { "oversized, nested",       { 50, 50, 100, 100 }, { -70000, -70000, 140000, 140000 },          { 50, 50, 150, 150 } },
+    { "from INT_MIN, nested",    { 50, 50, 100, 100 }, { INT_MIN, INT_MIN, INT_MAX, INT_MAX },       { 0 } },
+    { "to INT_MAX, nested",      { 50, 50, 100, 100 }, { -40000, -40000, INT_MAX, INT_MAX },        { 50, 50, 150, 150 } },
+};
+
+static void visible_rect(int* visible, int width)
+{
+    // the scissor in place when the rectangle is drawn, mapped back from the rotated framebuffer to the screen
+    size_t count;
+    const trace_cmd_t* cmds = c3d_trace_commands(&count);
+    u32 mode = GPU_SCISSOR_DISABLE, from = 0, to = 0;
+    bool drawn = false;
+    for (size_t i = 0; i < count && !drawn; i++)
+    {
+        if (cmds[i].type == TRACE_SCISSOR)
+        {
+            mode = cmds[i].args[0];
+            from = cmds[i].args[1];
+            to = cmds[i].args[2];
+        }
+        drawn = cmds[i].type == TRACE_DRAW_ARRAYS || cmds[i].type == TRACE_DRAW_ELEMENTS;
+    }
+
+    memset(visible, 0, 4*sizeof(int));
+    if (!drawn)
+    {
+        return;
+    }
+    if (mode == GPU_SCISSOR_DISABLE)
+    {
+        visible[2] = width;
+        visible[3] = PP2D_SCREEN_HEIGHT;
+        return;
+    }
+    visible[0] = width - (int)(to >> 16);
+    visible[1] = PP2D_SCREEN_HEIGHT - (int)(to & 0xFFFF);
+    visible[2] = width - (int)(from >> 16);
+    visible[3] = PP2D_SCREEN_HEIGHT - (int)(from & 0xFFFF);
+}
+
+static bool same_area(const int* a, const int* b)
+{
+    const bool emptyA = a[2] <= a[0] || a[3] <= a[1];
+    const bool emptyB = b[2] <= b[0] || b[3] <= b[1];
+    return emptyA || emptyB ? emptyA == emptyB : memcmp(a, b, 4*sizeof(int)) == 0;
+}
+
+int main(void)
+{
+    pp2d_init();
+    c3d_trace_capture(true);
+
+    bool passed = true;
+    for (size_t i = 0; i < sizeof(cases)/sizeof(cases[0]); i++)
+    {
+        const clip_case_t* test = &cases[i];
+        pp2d_frame_begin(GFX_TOP, GFX_LEFT);
+        c3d_trace_reset();
+            if (test->outer[2] != 0)
+            {
+                pp2d_push_clip(test->outer[0], test->outer[1], test->outer[2], test->outer[3]);
+            }
+            pp2d_push_clip(test->inner[0], test->inner[1], test->inner[2], test->inner[3]);
+            pp2d_draw_rectangle(0, 0, PP2D_SCREEN_TOP_WIDTH, PP2D_SCREEN_HEIGHT, RGBA8(255, 0, 0, 255));
+        pp2d_frame_end();
+
+        int visible[4];
+        visible_rect(visible, PP2D_SCREEN_TOP_WIDTH);
+        const bool match = same_area(visible, test->visible);
+        printf("%-24s shows %d,%d to %d,%d, expected %d,%d to %d,%d: %s\n", test->name, visible[0], visible[1], visible[2], visible[3],
+            test->visible[0], test->visible[1], test->visible[2], test->visible[3], match ? "ok" : "FAILED");
+        passed = passed && match;
+    }
+
+    // static layers and tile maps draw through projections of their own in the opaque pass, the scissor still maps to the bottom screen
+    u32* sheet = linearAlloc(64*64*4);
+    memset(sheet, 0xFF, 64*64*4);
+    pp2d_load_texture_memory(0, sheet, 64, 64, GX_TRANSFER_FMT_RGBA8);
+    linearFree(sheet);
+    u16 tiles[4] = { 1, 1, 1, 1 };
+    pp2d_tilemap_create(0, 0, 2, 2, 16, 16);
+    pp2d_tilemap_set_tiles(0, tiles);
+
+    static const char* names[] = { "static layer on bottom", "tile map on bottom" };
+    static const int expected[4] = { 10, 10, 110, 110 };
+    for (int i = 0; i < 2; i++)
+    {
+        pp2d_frame_begin(GFX_BOTTOM, GFX_LEFT);
+        if (i == 0)
+        {
+            pp2d_static_layer_begin(0);
+                pp2d_draw_rectangle(0, 0, PP2D_SCREEN_BOTTOM_WIDTH, PP2D_SCREEN_HEIGHT, RGBA8(255, 0, 0, 255));
+            pp2d_static_layer_end();
+        }
+        c3d_trace_reset();
+            pp2d_set_opaque_pass(true);
+            pp2d_push_clip(10, 10, 100, 100);
+            if (i == 0)
+            {
+                pp2d_static_layer_draw(0);
+            }
+            else
+            {
+                pp2d_tilemap_draw(0, 0, 0);
+            }
+            pp2d_pop_clip();
+            pp2d_set_opaque_pass(false);
+        pp2d_frame_end();
+
+        int visible[4];
+        visible_rect(visible, PP2D_SCREEN_BOTTOM_WIDTH);
+        const bool match = same_area(visible, expected);
+        printf("%-24s shows %d,%d to %d,%d, expected %d,%d to %d,%d: %s\n", names[i], visible[0], visible[1], visible[2], visible[3],
+            expected[0], expected[1], expected[2], expected[3], match ? "ok" : "FAILED");
+        passed = passed && match;
+    }
+
+    c3d_trace_capture(false);
+    pp2d_exit();
+    return passed ? 0 : 1;
+}
@@ -0,0 +1,72 @@
+/*  This file is part of pp2d
+>   Copyright (C) 2017/2018 Bernardo Giordano
+>
+>   This program is free software: you can redistribute it and/or modify
+>   it under the terms of the GNU General Public License as published by
+>   the Free Software Foundation, either version 3 of the License, or
+>   (at your option) any later version.
+>
+>   This program is distributed in the hope that it will be useful,
+>   but WITHOUT ANY WARRANTY; without even the implied warranty of
+>   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+>   GNU General Public License for more details.
+>
+>   You should have received a copy of the GNU General Public License
+>   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+>   See LICENSE for information.
+>
+>   https://discord.gg/bGKEyfY
+*/
+
+/**
+ * Plug & Play 2D
+ * @file culled_batch.c
+ * @brief a batch of sprites culled whole between two rectangles, checked for draws and texture binds it causes
+ */
+
+#include "pp2d.h"
+#include "c3d_trace.h"
+
+#define OFFSCREEN 16
+
+int main(void)
+{
+    pp2d_init();
+
+    u32* sheet = linearAlloc(64*64*4);
+    memset(sheet, 0xFF, 64*64*4);
+    pp2d_load_texture_memory(0, sheet, 64, 64, GX_TRANSFER_FMT_RGBA8);
+    linearFree(sheet);
+
+    // sprites left of the screen
+    pp2d_sprite_s sprites[OFFSCREEN];
+    for (int i = 0; i < OFFSCREEN; i++)
+    {
+        sprites[i] = (pp2d_sprite_s) { .x = -100 - i*20, .y = 10, .width = 16, .height = 16, .color = PP2D_DEFAULT_COLOR_NEUTRAL };
+    }
+
+    c3d_trace_capture(true);
+    pp2d_frame_begin(GFX_TOP, GFX_LEFT);
+    c3d_trace_reset();
+        pp2d_draw_rectangle(10, 10, 16, 16, RGBA8(255, 0, 0, 255));
+        pp2d_texture_queue_batch(0, sprites, OFFSCREEN, 0);
+        pp2d_draw_rectangle(40, 10, 16, 16, RGBA8(0, 255, 0, 255));
+    pp2d_frame_end();
+    c3d_trace_capture(false);
+
+    // both rectangles go in one draw, and no texture is bound
+    size_t count;
+    const trace_cmd_t* cmds = c3d_trace_commands(&count);
+    size_t draws = 0, binds = 0;
+    for (size_t i = 0; i < count; i++)
+    {
+        draws += cmds[i].type == TRACE_DRAW_ARRAYS || cmds[i].type == TRACE_DRAW_ELEMENTS;
+        binds += cmds[i].type == TRACE_TEX_BIND;
+    }
+
+    const bool passed = draws == 1 && binds == 0;
+    printf("%zu draw call(s) and %zu texture bind(s), expected 1 and 0: %s\n", draws, binds, passed ? "ok" : "FAILED");
+
+    pp2d_exit();
+    return passed ? 0 : 1;
+}
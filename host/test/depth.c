@@ -0,0 +1,159 @@
+/*  This file is part of pp2d
+>   Copyright (C) 2017/2018 Bernardo Giordano
+>
+>   This program is free software: you can redistribute it and/or modify
+>   it under the terms of the GNU General Public License as published by
+>   the Free Software Foundation, either version 3 of the License, or
+>   (at your option) any later version.
+>
+>   This program is distributed in the hope that it will be useful,
+>   but WITHOUT ANY WARRANTY; without even the implied warranty of
+>   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+>   GNU General Public License for more details.
+>
+>   You should have received a copy of the GNU General Public License
+>   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+>   See LICENSE for information.
+>
+>   https://discord.gg/bGKEyfY
+*/
+
+/**
+ * Plug & Play 2D
+ * @file depth.c
+ * @brief a tile map and a static layer drawn among opaque sprites on two layers during the opaque pass, and sprites sorted by depth
+ */
+
+#include "pp2d.h"
+#include "c3d_trace.h"
+
+#define MAX_DEPTH_ERROR 1e-4f
+#define MAX_DRAWS 8
+
+static float vertex_depth(const vertex_s* vtx)
+{
+#if PP2D_COMPACT_VERTICES
+    return vtx->z / 32767.0f;
+#else
+    return vtx->z;
+#endif
+}
+
+static size_t collect_depths(float* depths, bool eachSprite)
+{
+    // the depth each draw, or each sprite of indexed draws, writes: its first vertex through the projection set before it,
+    // which the first frame after pp2d_init always sets and later traces keep when it doesn't change, then mapped by the
+    // default C3D_DepthMap to the negated clip z. The depth test keeps the greater one
+    const int projection = shaderInstanceGetUniformLocation(NULL, "projection");
+    size_t count, size;
+    const trace_cmd_t* cmds = c3d_trace_commands(&count);
+    const u8* blob = c3d_trace_vertices(&size);
+    static C3D_FVec matrix[4];
+
+    size_t draws = 0;
+    for (size_t i = 0; i < count; i++)
+    {
+        if (cmds[i].type == TRACE_UNIFORM && cmds[i].args[0] == GPU_VERTEX_SHADER && (int)cmds[i].args[1] == projection && c3d_trace_uniform_values(&cmds[i]) != NULL)
+        {
+            memcpy(matrix, c3d_trace_uniform_values(&cmds[i]), sizeof(matrix));
+        }
+        if (cmds[i].type != TRACE_DRAW_ARRAYS && cmds[i].type != TRACE_DRAW_ELEMENTS)
+        {
+            continue;
+        }
+
+        // sprites are drawn from 6 indices, whether they are written as 4 or 6 vertices
+        const vertex_s* vertices = (const vertex_s*)(blob + cmds[i].vtxOffset);
+        const u16* indices = cmds[i].type == TRACE_DRAW_ELEMENTS ? c3d_trace_indices(&cmds[i]) : NULL;
+        const u32 sprites = eachSprite && indices != NULL ? cmds[i].args[1]/6 : 1;
+        for (u32 sprite = 0; sprite < sprites && draws < MAX_DRAWS; sprite++)
+        {
+            const vertex_s* vtx = &vertices[indices != NULL ? indices[sprite*6] : 0];
+            depths[draws++] = -(matrix[2].z*vertex_depth(vtx) + matrix[2].w);
+        }
+    }
+    return draws;
+}
+
+static void queue_sprite(int x, int y, float depth)
+{
+    pp2d_texture_select_part(0, x, y, 0, 0, 16, 16);
+    pp2d_texture_depth(depth);
+    pp2d_texture_queue();
+}
+
+int main(void)
+{
+    pp2d_init();
+
+    u32* sheet = linearAlloc(64*64*4);
+    memset(sheet, 0xFF, 64*64*4);
+    pp2d_load_texture_memory(0, sheet, 64, 64, GX_TRANSFER_FMT_RGBA8);
+    linearFree(sheet);
+
+    u16 tiles[4][8];
+    for (int tile = 0; tile < 4*8; tile++)
+    {
+        tiles[tile / 8][tile % 8] = 1;
+    }
+    pp2d_tilemap_create(0, 0, 8, 4, 16, 16);
+    pp2d_tilemap_set_tiles(0, &tiles[0][0]);
+
+    c3d_trace_capture(true);
+    c3d_trace_reset();
+    pp2d_frame_begin(GFX_TOP, GFX_LEFT);
+        pp2d_static_layer_begin(0);
+            queue_sprite(24, 24, PP2D_DEFAULT_DEPTH);
+        pp2d_static_layer_end();
+
+        // the map is the background of layer 0, the static layer and a sprite go over it on layer 1
+        pp2d_set_opaque_pass(true);
+        pp2d_set_draw_opaque(true);
+        pp2d_set_draw_layer(0);
+        queue_sprite(0, 0, PP2D_DEFAULT_DEPTH);
+        pp2d_tilemap_draw(0, 0, 0);
+        pp2d_set_draw_layer(1);
+        pp2d_static_layer_draw(0);
+        queue_sprite(8, 8, PP2D_DEFAULT_DEPTH);
+    pp2d_frame_end();
+    c3d_trace_capture(false);
+
+    // the layer 0 sprite is drawn before the map, then the map, the static layer and the layer 1 sprite
+    static const char* names[] = { "sprite on layer 0", "tile map on layer 0", "static layer on layer 1", "sprite on layer 1" };
+    static const int layers[] = { 0, 0, 1, 1 };
+    float depths[MAX_DRAWS];
+    const size_t draws = collect_depths(depths, false);
+    C3D_Mtx projection;
+    Mtx_OrthoTilt(&projection, 0, PP2D_SCREEN_TOP_WIDTH, PP2D_SCREEN_HEIGHT, 0.0f, 0.0f, 1.0f, true);
+    bool passed = draws == 4;
+    for (size_t i = 0; i < draws && i < 4; i++)
+    {
+        const float expected = -(projection.r[2].z*(1.0f - (layers[i] + 1)*(1.0f/256)) + projection.r[2].w);
+        const bool match = fabsf(depths[i] - expected) <= MAX_DEPTH_ERROR;
+        printf("%-24s depth %9.6f, expected %9.6f: %s\n", names[i], depths[i], expected, match ? "ok" : "FAILED");
+        passed = passed && match;
+    }
+
+    // the layer 1 draws must write a greater depth than the map to show over it
+    const bool visible = draws == 4 && depths[2] > depths[1] && depths[3] > depths[1];
+    printf("%zu draw call(s), layer 1 over the tile map: %s\n", draws, visible ? "ok" : "FAILED");
+
+    // sorted sprites are drawn from the back, the smallest depth written, to the front
+    c3d_trace_capture(true);
+    c3d_trace_reset();
+    pp2d_frame_begin(GFX_TOP, GFX_LEFT);
+        pp2d_set_opaque_pass(false);
+        pp2d_set_draw_sorting(true);
+        queue_sprite(0, 0, 0.2f);
+        queue_sprite(8, 8, 0.8f);
+        pp2d_set_draw_sorting(false);
+    pp2d_frame_end();
+    c3d_trace_capture(false);
+
+    const size_t sorted = collect_depths(depths, true);
+    const bool backToFront = sorted == 2 && depths[0] < depths[1];
+    printf("%zu sorted sprite(s), depth 0.8 drawn before depth 0.2: %s\n", sorted, backToFront ? "ok" : "FAILED");
+
+    pp2d_exit();
+    return passed && visible && backToFront ? 0 : 1;
+}
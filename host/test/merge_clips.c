@@ -0,0 +1,76 @@
+/*  This file is part of pp2d
+>   Copyright (C) 2017/2018 Bernardo Giordano
+>
+>   This program is free software: you can redistribute it and/or modify
+>   it under the terms of the GNU General Public License as published by
+>   the Free Software Foundation, either version 3 of the License, or
+>   (at your option) any later version.
+>
+>   This program is distributed in the hope that it will be useful,
+>   but WITHOUT ANY WARRANTY; without even the implied warranty of
+>   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+>   GNU General Public License for more details.
+>
+>   You should have received a copy of the GNU General Public License
+>   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+>   See LICENSE for information.
+>
+>   https://discord.gg/bGKEyfY
+*/
+
+/**
+ * Plug & Play 2D
+ * @file merge_clips.c
+ * @brief rectangles merged across clip rects pushed again, clip rects that cut nothing and a clip rect that cuts one of them
+ */
+
+#include "pp2d.h"
+#include "c3d_trace.h"
+
+static void clipped_rectangle(int clipWidth, int x, int y)
+{
+    pp2d_push_clip(0, 0, clipWidth, PP2D_SCREEN_HEIGHT);
+        pp2d_draw_rectangle(x, y, 16, 16, RGBA8(255, 0, 0, 255));
+    pp2d_pop_clip();
+}
+
+int main(void)
+{
+    pp2d_init();
+
+    u32* sheet = linearAlloc(64*64*4);
+    memset(sheet, 0xFF, 64*64*4);
+    pp2d_load_texture_memory(0, sheet, 64, 64, GX_TRANSFER_FMT_RGBA8);
+    linearFree(sheet);
+
+    c3d_trace_capture(true);
+    pp2d_frame_begin(GFX_TOP, GFX_LEFT);
+    c3d_trace_reset();
+        pp2d_set_batch_merging(true);
+        clipped_rectangle(200, 10, 10);
+        // a sprite away from the rectangles, so they have something to merge across
+        pp2d_texture_select_part(0, 300, 10, 0, 0, 16, 16);
+        pp2d_texture_queue();
+        // the same clip rect pushed again, then a narrower one the rectangle still fits in: both join the first rectangle
+        clipped_rectangle(200, 40, 10);
+        clipped_rectangle(100, 50, 50);
+        // a clip rect cutting the rectangle keeps it apart
+        clipped_rectangle(30, 20, 100);
+        pp2d_set_batch_merging(false);
+    pp2d_frame_end();
+    c3d_trace_capture(false);
+
+    size_t count;
+    const trace_cmd_t* cmds = c3d_trace_commands(&count);
+    size_t draws = 0;
+    for (size_t i = 0; i < count; i++)
+    {
+        draws += cmds[i].type == TRACE_DRAW_ARRAYS || cmds[i].type == TRACE_DRAW_ELEMENTS;
+    }
+
+    const bool passed = draws == 3;
+    printf("%zu draw call(s), expected 3: %s\n", draws, passed ? "ok" : "FAILED");
+
+    pp2d_exit();
+    return passed ? 0 : 1;
+}
@@ -0,0 +1,153 @@
+/*  This file is part of pp2d
+>   Copyright (C) 2017/2018 Bernardo Giordano
+>
+>   This program is free software: you can redistribute it and/or modify
+>   it under the terms of the GNU General Public License as published by
+>   the Free Software Foundation, either version 3 of the License, or
+>   (at your option) any later version.
+>
+>   This program is distributed in the hope that it will be useful,
+>   but WITHOUT ANY WARRANTY; without even the implied warranty of
+>   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+>   GNU General Public License for more details.
+>
+>   You should have received a copy of the GNU General Public License
+>   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+>   See LICENSE for information.
+>
+>   https://discord.gg/bGKEyfY
+*/
+
+/**
+ * Plug & Play 2D
+ * @file nine_slice.c
+ * @brief positions and texture coordinates of the quads of nine slice panels, larger and smaller than their borders
+ */
+
+#include "pp2d.h"
+#include "c3d_trace.h"
+
+#define MAX_POSITION_ERROR 0.001f
+#define MAX_TEXCOORD_ERROR 0.0001f
+#define MAX_QUADS 16
+
+// a 32x24 panel at 8,4 of a 64x64 texture, with borders of 6, 4, 10 and 8 pixels
+static const pp2d_nine_slice_s panel = { .xbegin = 8, .ybegin = 4, .width = 32, .height = 24, .left = 6, .top = 4, .right = 10, .bottom = 8 };
+
+// the screen and texture rectangle of a quad
+typedef struct {
+    float left, top, right, bottom;
+    float u0, v0, u1, v1;
+} slice_quad_t;
+
+typedef struct {
+    const char* name;
+    int x, y, width, height;
+    size_t count;
+    slice_quad_t quads[9];
+} slice_case_t;
+
+#define U(x) ((x)/64.0f)
+#define V(y) (1.0f - (y)/64.0f)
+
+static const slice_case_t cases[] = {
+    // borders kept, edges and center stretched: columns at 20, 26, 110, 120 and rows at 30, 34, 82, 90
+    { "100x60 panel", 20, 30, 100, 60, 9, {
+        { 20, 30, 26, 34, U(8), V(4), U(14), V(8) },    { 26, 30, 110, 34, U(14), V(4), U(30), V(8) },    { 110, 30, 120, 34, U(30), V(4), U(40), V(8) },
+        { 20, 34, 26, 82, U(8), V(8), U(14), V(20) },   { 26, 34, 110, 82, U(14), V(8), U(30), V(20) },   { 110, 34, 120, 82, U(30), V(8), U(40), V(20) },
+        { 20, 82, 26, 90, U(8), V(20), U(14), V(28) },  { 26, 82, 110, 90, U(14), V(20), U(30), V(28) },  { 110, 82, 120, 90, U(30), V(20), U(40), V(28) },
+    } },
+    // smaller than the borders: they shrink to half, 3 and 5 pixels across, 2 and 4 down, and the empty edges and center are skipped
+    { "8x6 panel", 50, 60, 8, 6, 4, {
+        { 50, 60, 53, 62, U(8), V(4), U(14), V(8) },    { 53, 60, 58, 62, U(30), V(4), U(40), V(8) },
+        { 50, 62, 53, 66, U(8), V(20), U(14), V(28) },  { 53, 62, 58, 66, U(30), V(20), U(40), V(28) },
+    } },
+};
+
+static float vertex_value(s16 compact, float value, float one)
+{
+#if PP2D_COMPACT_VERTICES
+    (void)value;
+    return compact / one;
+#else
+    (void)compact;
+    (void)one;
+    return value;
+#endif
+}
+
+static size_t collect_quads(slice_quad_t* quads)
+{
+    // quads are written top left, bottom left, top right, bottom right
+#if PP2D_INDEXED_QUADS
+    static const int bottomRight = 3;
+#else
+    static const int bottomRight = 5;
+#endif
+    size_t size;
+    const vertex_s* vertices = (const vertex_s*)c3d_trace_vertices(&size);
+    size_t count = 0;
+    for (size_t first = 0; first + PP2D_QUAD_VERTICES <= size / sizeof(vertex_s) && count < MAX_QUADS; first += PP2D_QUAD_VERTICES)
+    {
+        const vertex_s* topLeft = &vertices[first];
+        const vertex_s* last = &vertices[first + bottomRight];
+        quads[count++] = (slice_quad_t) {
+            vertex_value(topLeft->x, topLeft->x, 16.0f), vertex_value(topLeft->y, topLeft->y, 16.0f),
+            vertex_value(last->x, last->x, 16.0f), vertex_value(last->y, last->y, 16.0f),
+            vertex_value(topLeft->u, topLeft->u, 32767.0f), vertex_value(topLeft->v, topLeft->v, 32767.0f),
+            vertex_value(last->u, last->u, 32767.0f), vertex_value(last->v, last->v, 32767.0f)
+        };
+    }
+    return count;
+}
+
+static bool same_quad(const slice_quad_t* a, const slice_quad_t* b)
+{
+    return fabsf(a->left - b->left) <= MAX_POSITION_ERROR && fabsf(a->top - b->top) <= MAX_POSITION_ERROR
+        && fabsf(a->right - b->right) <= MAX_POSITION_ERROR && fabsf(a->bottom - b->bottom) <= MAX_POSITION_ERROR
+        && fabsf(a->u0 - b->u0) <= MAX_TEXCOORD_ERROR && fabsf(a->v0 - b->v0) <= MAX_TEXCOORD_ERROR
+        && fabsf(a->u1 - b->u1) <= MAX_TEXCOORD_ERROR && fabsf(a->v1 - b->v1) <= MAX_TEXCOORD_ERROR;
+}
+
+static size_t queue_panel(const pp2d_nine_slice_s* slice, int x, int y, int width, int height, slice_quad_t* quads)
+{
+    c3d_trace_reset();
+    pp2d_frame_begin(GFX_TOP, GFX_LEFT);
+        pp2d_texture_queue_nine_slice(0, slice, x, y, width, height, RGBA8(255, 255, 255, 255));
+    pp2d_frame_end();
+    return collect_quads(quads);
+}
+
+int main(void)
+{
+    pp2d_init();
+
+    u32* sheet = linearAlloc(64*64*4);
+    memset(sheet, 0xFF, 64*64*4);
+    pp2d_load_texture_memory(0, sheet, 64, 64, GX_TRANSFER_FMT_RGBA8);
+    linearFree(sheet);
+    c3d_trace_capture(true);
+
+    bool passed = true;
+    slice_quad_t quads[MAX_QUADS];
+    for (size_t i = 0; i < sizeof(cases)/sizeof(cases[0]); i++)
+    {
+        const slice_case_t* test = &cases[i];
+        const size_t count = queue_panel(&panel, test->x, test->y, test->width, test->height, quads);
+        int mismatches = count != test->count;
+        for (size_t quad = 0; quad < count && quad < test->count; quad++)
+        {
+            mismatches += !same_quad(&quads[quad], &test->quads[quad]);
+        }
+        printf("%-14s %zu quad(s), expected %zu, %d mismatches: %s\n", test->name, count, test->count, mismatches, mismatches == 0 ? "ok" : "FAILED");
+        passed = passed && mismatches == 0;
+    }
+
+    const size_t count = queue_panel(NULL, 20, 30, 100, 60, quads);
+    printf("%-14s %zu quad(s), expected 0: %s\n", "no slice", count, count == 0 ? "ok" : "FAILED");
+    passed = passed && count == 0;
+
+    c3d_trace_capture(false);
+    pp2d_exit();
+    return passed ? 0 : 1;
+}
@@ -0,0 +1,101 @@
+/*  This file is part of pp2d
+>   Copyright (C) 2017/2018 Bernardo Giordano
+>
+>   This program is free software: you can redistribute it and/or modify
+>   it under the terms of the GNU General Public License as published by
+>   the Free Software Foundation, either version 3 of the License, or
+>   (at your option) any later version.
+>
+>   This program is distributed in the hope that it will be useful,
+>   but WITHOUT ANY WARRANTY; without even the implied warranty of
+>   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+>   GNU General Public License for more details.
+>
+>   You should have received a copy of the GNU General Public License
+>   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+>   See LICENSE for information.
+>
+>   https://discord.gg/bGKEyfY
+*/
+
+/**
+ * Plug & Play 2D
+ * @file tile_changes.c
+ * @brief a tile map drawn, changed and drawn again in the same frame, checked for vertices overwritten before the GPU reads them,
+ * and a map given no tiles
+ */
+
+#include "pp2d.h"
+#include "c3d_trace.h"
+
+#define MAX_DRAWS 8
+
+static size_t collect_draws(const trace_cmd_t** draws)
+{
+    size_t count;
+    const trace_cmd_t* cmds = c3d_trace_commands(&count);
+    size_t drawCount = 0;
+    for (size_t i = 0; i < count && drawCount < MAX_DRAWS; i++)
+    {
+        if (cmds[i].type == TRACE_DRAW_ARRAYS || cmds[i].type == TRACE_DRAW_ELEMENTS)
+        {
+            draws[drawCount++] = &cmds[i];
+        }
+    }
+    return drawCount;
+}
+
+static bool draw_intact(const trace_cmd_t* draw)
+{
+    // the GPU reads the vertices when the frame is done, so they must still be what the draw was given
+    size_t size;
+    const u8* blob = c3d_trace_vertices(&size);
+    const u32 first = draw->type == TRACE_DRAW_ELEMENTS ? draw->args[3] : draw->args[1];
+    const u8* vertices = (const u8*)draw->ptr + first*sizeof(vertex_s);
+    return memcmp(vertices, blob + draw->vtxOffset, draw->vtxBytes) == 0;
+}
+
+int main(void)
+{
+    pp2d_init();
+
+    u32* sheet = linearAlloc(64*64*4);
+    memset(sheet, 0xFF, 64*64*4);
+    pp2d_load_texture_memory(0, sheet, 64, 64, GX_TRANSFER_FMT_RGBA8);
+    linearFree(sheet);
+
+    u16 tiles[4] = { 1, 1, 1, 1 };
+    pp2d_tilemap_create(0, 0, 2, 2, 16, 16);
+    pp2d_tilemap_set_tiles(0, tiles);
+    pp2d_tilemap_set_tiles(0, NULL);
+    const bool kept = pp2d_tilemap_get_tile(0, 1, 1) == 1;
+    printf("no tiles given, map kept: %s\n", kept ? "ok" : "FAILED");
+
+    c3d_trace_capture(true);
+    c3d_trace_reset();
+    pp2d_frame_begin(GFX_TOP, GFX_LEFT);
+        pp2d_tilemap_draw(0, 0, 0);
+        pp2d_tilemap_set_tile(0, 0, 0, 2);
+        pp2d_tilemap_draw(0, 0, 0);
+    pp2d_frame_end();
+    c3d_trace_capture(false);
+
+    const trace_cmd_t* draws[MAX_DRAWS];
+    const size_t count = collect_draws(draws);
+    bool passed = kept && count == 2;
+    for (size_t i = 0; i < count; i++)
+    {
+        const bool intact = draw_intact(draws[i]);
+        printf("draw %zu of %zu, vertices intact at the end of the frame: %s\n", i + 1, count, intact ? "ok" : "FAILED");
+        passed = passed && intact;
+    }
+
+    // the second draw shows the changed tile
+    size_t size;
+    const u8* blob = c3d_trace_vertices(&size);
+    const bool changed = count == 2 && memcmp(blob + draws[0]->vtxOffset, blob + draws[1]->vtxOffset, draws[0]->vtxBytes) != 0;
+    printf("changed tile drawn the second time: %s\n", changed ? "ok" : "FAILED");
+
+    pp2d_exit();
+    return passed && changed ? 0 : 1;
+}
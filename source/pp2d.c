@@ -32,12 +32,142 @@
 static DVLB_s* vshader_dvlb;
 static shaderProgram_s program;
 static int uLoc_projection;
+static int uLoc_attrScale;
+
+// geometry shader sprites
+static DVLB_s* sprite_dvlb;
+static shaderProgram_s spriteProgram;
+static int uLoc_spriteProjection;
+
+// instanced sprites
+static DVLB_s* instance_dvlb;
+static shaderProgram_s instanceProgram;
+static int uLoc_instanceProjection;
+static int uLoc_instances[4];
+
+typedef enum {
+    PP2D_PROGRAM_QUADS,
+    PP2D_PROGRAM_SPRITES,
+    PP2D_PROGRAM_INSTANCES
+} pp2d_program_t;
+
+static pp2d_program_t currentProgram;
+
+typedef enum {
+    PP2D_ENV_NONE,
+    PP2D_ENV_RECTANGLE,
+    PP2D_ENV_TEXT,
+    PP2D_ENV_TEXTURE
+} pp2d_env_t;
+
+// clip rect in pixels of the target and stencil mask, PP2D_CLIP_NONE when nothing is clipped.
+// The mask keeps its stencil reference in the low byte, and whether draws write it or are tested against it
+typedef struct {
+    s16 left;
+    s16 top;
+    s16 right;
+    s16 bottom;
+    u16 mask;
+} pp2d_clip_t;
+
+#define PP2D_MASK_WRITE 0x100
+#define PP2D_MASK_TEST 0x200
+
+static const pp2d_clip_t PP2D_CLIP_NONE = { INT16_MIN, INT16_MIN, INT16_MAX, INT16_MAX, 0 };
+
+// shadow of the GPU state set by pp2d, so identical state is never emitted twice
+static struct {
+    const C3D_Tex* texture;
+    pp2d_env_t env;
+    pp2d_clip_t clip;
+    // indexed by shader stage: both vertex shader programs keep the projection in the same registers
+    C3D_Mtx projection[2];
+    bool projectionValid[2];
+} gpuState;
+static const C3D_Mtx* targetProjection;
+// width of the current target, as tile maps and static layers draw through projections of their own
+static int targetWidth;
+static pp2d_state_stats_s stateStats;
+
+// primitives entirely outside left, top, right and bottom are dropped before writing their vertices
+static float cullBounds[4];
+
+// clip rects pushed on the current target, each with the clip and cull bounds it narrowed.
+// The current clip is set on the GPU when something is drawn
+static struct {
+    pp2d_clip_t clip;
+    float cullBounds[4];
+} clipStack[PP2D_MAX_CLIP_RECTS];
+static size_t clipDepth;
+static size_t clipOverflow;
+static pp2d_clip_t currentClip;
+// stencil reference of the last mask begun this frame, the stencil buffer is cleared with the depth buffer
+static u8 maskRef;
+
+// runs of vertices recorded while sorting or merging draws, replayed in a new order when the target changes or the frame ends
+typedef struct {
+    u64 key;
+    const C3D_Tex* texture;
+    float bounds[4];
+    u32 first;
+    u32 count;
+    u32 chunk;
+    pp2d_program_t program;
+    pp2d_env_t env;
+    pp2d_clip_t clip;
+} pp2d_draw_item_t;
+
+typedef struct {
+    u64 key;
+    u32 item;
+} pp2d_sort_key_t;
+
+// batches of runs sharing state, built when merging draws
+typedef struct {
+    u32 state;
+    u32 first;
+    u32 last;
+    float bounds[4];
+} pp2d_batch_t;
+
+typedef struct {
+    pp2d_draw_item_t* items;
+    pp2d_sort_key_t* keys;
+    pp2d_sort_key_t* scratch;
+    pp2d_batch_t* batches;
+    u32* next;
+    size_t count;
+    size_t capacity;
+    const C3D_Tex* texture;
+    pp2d_env_t env;
+    pp2d_program_t program;
+    pp2d_clip_t clip;
+    u16 clipId;
+    float depth;
+    float bounds[4];
+    u8 layer;
+    bool opaque;
+} pp2d_draw_list_t;
+
+static pp2d_draw_list_t drawList;
+static bool recordDraws;
+static bool sortDraws;
+static bool mergeDraws;
+// sorted draws written at the depth of their layer, opaque ones drawn first from front to back
+static bool opaquePass;
 
 // targets
 static C3D_RenderTarget* topLeft;
 static C3D_RenderTarget* topRight;
 static C3D_RenderTarget* bot;
 
+// screens whose picture is kept from the last frame that drew on them, indexed by gfxScreen_t.
+// Both framebuffers have to hold that picture first, so an unchanged screen is still drawn once
+static bool unchangedScreens[2];
+static u8 unchangedRedraws[2];
+static bool drawnScreens[2];
+static bool discardDraws;
+
 // projection matrices
 static C3D_Mtx projectionTopLeft;
 static C3D_Mtx projectionTopRight;
@@ -46,14 +176,153 @@ static C3D_Mtx projectionBot;
 // text data
 static C3D_Tex* glyphSheets;
 static float s_textScale;
-static int lastSheet = -1;
 
-// vbo buffer and positions
+// deferred text, grouped by glyph sheet when drawn
 static struct {
+    float x;
+    float y;
+    fontGlyphPos_s data;
+    u32 color;
+    pp2d_clip_t clip;
+} *deferredGlyphs;
+static u16* deferredOrder;
+static u32* deferredSheetStart;
+static size_t deferredCount;
+static bool deferredText;
+
+// vertex buffers, continued into extra chunks of linear memory when a frame outgrows one.
+// Each chunk is tagged with the last frame it was used in, as the GPU may read it until the next frame begins
+typedef struct {
     size_t cur;
     size_t old;
-    vertex_s* vbo;
-} vertexData;
+    void* vbo;
+    size_t capacity;
+    size_t stride;
+    size_t chunk;
+    size_t chunkCount;
+    void** chunks;
+    u32* frames;
+} pp2d_buffer_t;
+
+static pp2d_buffer_t vertexData;
+static u32 currentFrame;
+
+// one point per sprite, expanded to a quad by the geometry shader
+typedef struct {
+    float x, y, z, angle;
+    float halfWidth, halfHeight;
+    float left, top, right, bottom;
+    u32 color;
+} sprite_vertex_s;
+
+static pp2d_buffer_t spriteData;
+static bool geometrySprites;
+
+// sprites read from uniform arrays by the instance shader, which holds this many per draw call.
+// The GPU has no instance id, so each vertex carries its corner and the number of its sprite
+#define PP2D_INSTANCE_SPRITES 22
+
+typedef enum {
+    PP2D_INSTANCE_CENTER,
+    PP2D_INSTANCE_AXIS,
+    PP2D_INSTANCE_TEXRECT,
+    PP2D_INSTANCE_TINT
+} pp2d_instance_array_t;
+
+static u8* instanceVbo;
+static C3D_FVec instanceData[4][PP2D_INSTANCE_SPRITES];
+static size_t instanceCount;
+static bool instancedSprites;
+
+// indices of the recorded runs, in the order they are replayed
+static pp2d_buffer_t indexData;
+
+// static layers keep their runs and vertices across frames, until they are recorded again
+typedef struct {
+    pp2d_draw_list_t list;
+    pp2d_buffer_t vertexData;
+    pp2d_buffer_t spriteData;
+    bool clean;
+} pp2d_static_layer_t;
+
+static pp2d_static_layer_t staticLayers[PP2D_MAX_STATIC_LAYERS];
+
+// tile maps keep the vertices of each chunk of up to PP2D_TILEMAP_CHUNK x PP2D_TILEMAP_CHUNK tiles in linear memory,
+// relative to the chunk's corner, and write them again only when one of its tiles changed
+typedef struct {
+    u16* tiles;
+    pp2d_buffer_t* chunks;
+    bool* dirty;
+    size_t texture;
+    int columns;
+    int rows;
+    int tileWidth;
+    int tileHeight;
+    int chunkColumns;
+    int chunkRows;
+    // tiles across and down a chunk, fewer than PP2D_TILEMAP_CHUNK when compact positions can't reach its far side
+    int chunkTileColumns;
+    int chunkTileRows;
+} pp2d_tilemap_t;
+
+static pp2d_tilemap_t tilemaps[PP2D_MAX_TILEMAPS];
+
+// particle emitters keep each property of their particles in its own array, so updates run down one property at a time
+typedef struct {
+    float* x;
+    float* y;
+    float* velocityX;
+    float* velocityY;
+    // age as a fraction of the lifetime, and the fraction added every second
+    float* age;
+    float* aging;
+    size_t count;
+    size_t capacity;
+    size_t texture;
+    pp2d_emitter_s settings;
+    // area the particles were in after the last update or emission
+    float bounds[4];
+    u32 seed;
+} pp2d_emitter_t;
+
+static pp2d_emitter_t emitters[PP2D_MAX_EMITTERS];
+
+// what a static layer being recorded replaced, given back when the recording ends
+static struct {
+    pp2d_static_layer_t* layer;
+    pp2d_draw_list_t drawList;
+    pp2d_buffer_t vertexData;
+    pp2d_buffer_t spriteData;
+    bool recordDraws;
+    bool sortDraws;
+    bool mergeDraws;
+    bool opaquePass;
+    bool deferredText;
+    float cullBounds[4];
+    pp2d_clip_t clip;
+    // modes changed while recording, applied once it ends
+    bool sortRequest;
+    bool mergeRequest;
+    bool opaqueRequest;
+    bool deferredTextRequest;
+} layerRecording;
+
+#if PP2D_COMPACT_VERTICES
+#define PP2D_COMPACT_POSITION_ONE 16.0f
+#define PP2D_COMPACT_UNIT_ONE 32767.0f
+#endif
+
+#if PP2D_INDEXED_QUADS
+// static index buffer shared by every quad
+static u16* quadIndices;
+#endif
+
+#if PP2D_LUT_ROTATION
+// sines of a full turn, followed by a quarter turn more for the cosines and one entry to interpolate the last step
+#define PP2D_SIN_STEPS 1024
+#define PP2D_ANGLE_LIMIT 1e7f
+static float sinTable[PP2D_SIN_STEPS + PP2D_SIN_STEPS/4 + 1];
+#endif
 
 // texture buffer
 static struct {
@@ -80,68 +349,636 @@ static struct {
     bool initialized;
 } pp2dBuffer;
 
-static u32 prevColor;
-static size_t prevSpritesheet;
-static bool renderedText;
-static bool renderedRectangle;
-static bool renderedTexture;
-
 // texture filters
 static struct {
     GPU_TEXTURE_FILTER_PARAM magFilter;
     GPU_TEXTURE_FILTER_PARAM minFilter;
 } textureFilters;
 
-static void pp2d_add_text_vertex(float vx, float vy, float vz, float tx, float ty);
+static void pp2d_add_glyph(float x, float y, const fontGlyphPos_s* data, u32 color);
+static void pp2d_add_quad(const float vert[4][2], float depth, float left, float top, float right, float bottom, u32 color);
+static void pp2d_add_sprite(float x, float y, float width, float height, float angle, float depth, float left, float top, float right, float bottom, u32 color);
+static void pp2d_add_text_vertex(float vx, float vy, float vz, float tx, float ty, u32 color);
+static void pp2d_bind_program(pp2d_program_t target);
+static void pp2d_bind_mask(u16 mask);
+static void pp2d_bind_scissor(const pp2d_clip_t* clip);
+static void pp2d_bind_texture(size_t id);
+static void pp2d_bind_vbo(void);
+static void pp2d_buffer_free(pp2d_buffer_t* buffer);
+static bool pp2d_buffer_grow(pp2d_buffer_t* buffer);
+static bool pp2d_buffer_next(pp2d_buffer_t* buffer);
+static bool pp2d_buffer_reserve(pp2d_buffer_t* buffer, size_t count);
+static void pp2d_buffer_rewind(pp2d_buffer_t* buffer, size_t chunk);
+#if PP2D_COMPACT_VERTICES
+static inline s16 pp2d_compact(float value, float one);
+#endif
+static inline bool pp2d_culled(float left, float top, float right, float bottom);
+static inline bool pp2d_culled_sprite(float x, float y, float width, float height, float angle);
+static void pp2d_draw_batch(const pp2d_draw_item_t* state, size_t first, size_t count);
+static void pp2d_draw_instances(void);
+static void pp2d_draw_list_free(pp2d_draw_list_t* list);
+static void pp2d_draw_recorded(void);
 static void pp2d_draw_unprocessed_queue(void);
+static void pp2d_emitter_move(float* restrict x, float* restrict y, float* restrict velocityX, float* restrict velocityY, float* restrict age, const float* restrict aging, size_t count, float accelerationX, float accelerationY, float seconds);
+static void pp2d_emitter_write(vertex_s* restrict vertices, const pp2d_emitter_t* emitter, size_t first, size_t count, float depth, float left, float top, float right, float bottom);
 static void pp2d_get_text_size_internal(float* width, float* height, float scaleX, float scaleY, int wrapX, const char* text);
-static void pp2d_set_rendered_flags(bool texture, bool text, bool rectangle);
-static void pp2d_set_text_color(u32 color);
+static void pp2d_merge_draws(void);
+static inline u8 pp2d_next_mask_ref(void);
+static void pp2d_offset_projection(C3D_Mtx* out, const C3D_Mtx* projection, float x, float y);
+static inline float pp2d_random(u32* seed);
+static inline void pp2d_record_bounds(float left, float top, float right, float bottom);
+static inline float pp2d_record_depth(float depth);
+static inline void pp2d_record_reset_bounds(void);
+static void pp2d_record_run(void);
+static inline bool pp2d_same_clip(const pp2d_clip_t* a, const pp2d_clip_t* b);
+static inline bool pp2d_same_clip_within(const pp2d_clip_t* a, const pp2d_clip_t* b, const float* bounds);
+static inline bool pp2d_same_rect(const pp2d_clip_t* a, const pp2d_clip_t* b);
+static void pp2d_set_clip(const pp2d_clip_t* clip);
+static void pp2d_set_env(pp2d_env_t mode);
+static void pp2d_set_mask(u16 mask);
+static void pp2d_set_program(pp2d_program_t target);
+static void pp2d_set_record_mode(bool sort, bool merge, bool opaque);
+static void pp2d_set_projection(void);
+static void pp2d_set_screen_output(gfxScreen_t target, bool linked);
+static void pp2d_set_texture(const C3D_Tex* texture);
+static inline void pp2d_sincos(float angle, float* s, float* c);
+static void pp2d_sort_draws(void);
+static u32 pp2d_texture_slot(const C3D_Tex* texture);
+static bool pp2d_tilemap_build(pp2d_tilemap_t* map, int chunkColumn, int chunkRow);
+static inline void pp2d_write_vertex(vertex_s* vtx, float vx, float vy, float vz, float tx, float ty, u32 color);
+
+static void pp2d_add_glyph(float x, float y, const fontGlyphPos_s* data, u32 color)
+{
+    pp2d_set_texture(&glyphSheets[data->sheetIndex]);
+
+    const float vert[4][2] = {
+        {x + data->vtxcoord.left,  y + data->vtxcoord.top},
+        {x + data->vtxcoord.left,  y + data->vtxcoord.bottom},
+        {x + data->vtxcoord.right, y + data->vtxcoord.top},
+        {x + data->vtxcoord.right, y + data->vtxcoord.bottom},
+    };
+    pp2d_add_quad(vert, PP2D_DEFAULT_DEPTH, data->texcoord.left, data->texcoord.top, data->texcoord.right, data->texcoord.bottom, color);
+}
 
-static void pp2d_add_text_vertex(float vx, float vy, float vz, float tx, float ty)
+static void pp2d_add_quad(const float vert[4][2], float depth, float left, float top, float right, float bottom, u32 color)
 {
-    vertex_s* vtx = &vertexData.vbo[vertexData.cur++];
-    vtx->x = vx;
-    vtx->y = vy;
-    vtx->z = vz;
-    vtx->u = tx;
-    vtx->v = ty;
+    depth = pp2d_record_depth(depth);
+    if (!pp2d_buffer_reserve(&vertexData, PP2D_QUAD_VERTICES))
+    {
+        return;
+    }
+    if (recordDraws)
+    {
+        for (int i = 0; i < 4; i++)
+        {
+            pp2d_record_bounds(vert[i][0], vert[i][1], vert[i][0], vert[i][1]);
+        }
+    }
+
+    pp2d_add_text_vertex(vert[0][0], vert[0][1], depth, left, top, color);
+    pp2d_add_text_vertex(vert[1][0], vert[1][1], depth, left, bottom, color);
+    pp2d_add_text_vertex(vert[2][0], vert[2][1], depth, right, top, color);
+#if !PP2D_INDEXED_QUADS
+    pp2d_add_text_vertex(vert[2][0], vert[2][1], depth, right, top, color);
+    pp2d_add_text_vertex(vert[1][0], vert[1][1], depth, left, bottom, color);
+#endif
+    pp2d_add_text_vertex(vert[3][0], vert[3][1], depth, right, bottom, color);
+}
+
+static void pp2d_add_sprite(float x, float y, float width, float height, float angle, float depth, float left, float top, float right, float bottom, u32 color)
+{
+    if (geometrySprites)
+    {
+        depth = pp2d_record_depth(depth);
+        if (!pp2d_buffer_reserve(&spriteData, 1))
+        {
+            return;
+        }
+        if (recordDraws)
+        {
+            // any rotation stays within the circle through the corners
+            const float radius = (width + height)/2.0f;
+            pp2d_record_bounds(x + width/2.0f - radius, y + height/2.0f - radius, x + width/2.0f + radius, y + height/2.0f + radius);
+        }
+
+        // a single point, the geometry shader rotates and expands it
+        sprite_vertex_s* sprite = &((sprite_vertex_s*)spriteData.vbo)[spriteData.cur++];
+        sprite->halfWidth = width/2.0f;
+        sprite->halfHeight = height/2.0f;
+        sprite->x = x + sprite->halfWidth;
+        sprite->y = y + sprite->halfHeight;
+        sprite->z = depth;
+        sprite->angle = angle*(1.0f/360);
+        sprite->left = left;
+        sprite->top = top;
+        sprite->right = right;
+        sprite->bottom = bottom;
+        sprite->color = color;
+        return;
+    }
+
+    // instances can't be recorded, recorded sprites are written as quads
+    if (instancedSprites && !recordDraws)
+    {
+        if (instanceCount == PP2D_INSTANCE_SPRITES)
+        {
+            pp2d_draw_unprocessed_queue();
+        }
+
+        float s = 0, c = 1;
+        if (angle != 0)
+        {
+            pp2d_sincos(angle, &s, &c);
+        }
+        const float halfWidth = width/2.0f;
+        const float halfHeight = height/2.0f;
+
+        C3D_FVec* center = &instanceData[PP2D_INSTANCE_CENTER][instanceCount];
+        center->x = x + halfWidth;
+        center->y = y + halfHeight;
+        center->z = c*halfWidth;
+        center->w = s*halfWidth;
+
+        C3D_FVec* axis = &instanceData[PP2D_INSTANCE_AXIS][instanceCount];
+        axis->x = -s*halfHeight;
+        axis->y = c*halfHeight;
+        axis->z = depth;
+        axis->w = 0;
+
+        C3D_FVec* texrect = &instanceData[PP2D_INSTANCE_TEXRECT][instanceCount];
+        texrect->x = left;
+        texrect->y = top;
+        texrect->z = right - left;
+        texrect->w = bottom - top;
+
+        C3D_FVec* tint = &instanceData[PP2D_INSTANCE_TINT][instanceCount];
+        tint->x = (color & 0xFF)*(1.0f/255);
+        tint->y = ((color >> 8) & 0xFF)*(1.0f/255);
+        tint->z = ((color >> 16) & 0xFF)*(1.0f/255);
+        tint->w = (color >> 24)*(1.0f/255);
+
+        instanceCount++;
+        return;
+    }
+
+    if (angle == 0)
+    {
+        const float vert[4][2] = {
+            {        x,          y},
+            {        x, y + height},
+            {x + width,          y},
+            {x + width, y + height},
+        };
+        pp2d_add_quad(vert, depth, left, top, right, bottom, color);
+        return;
+    }
+
+    // rotating: the corners are the center plus or minus the rotated half width and half height axes
+    float s, c;
+    pp2d_sincos(angle, &s, &c);
+    const float halfWidth = width/2.0f;
+    const float halfHeight = height/2.0f;
+    const float xcenter = x + halfWidth;
+    const float ycenter = y + halfHeight;
+    const float ax = c*halfWidth;
+    const float ay = s*halfWidth;
+    const float bx = -s*halfHeight;
+    const float by = c*halfHeight;
+
+    const float vert[4][2] = {
+        {xcenter - ax - bx, ycenter - ay - by},
+        {xcenter - ax + bx, ycenter - ay + by},
+        {xcenter + ax - bx, ycenter + ay - by},
+        {xcenter + ax + bx, ycenter + ay + by},
+    };
+    pp2d_add_quad(vert, depth, left, top, right, bottom, color);
+}
+
+static void pp2d_add_text_vertex(float vx, float vy, float vz, float tx, float ty, u32 color)
+{
+    pp2d_write_vertex(&((vertex_s*)vertexData.vbo)[vertexData.cur++], vx, vy, vz, tx, ty, color);
+}
+
+static void pp2d_bind_program(pp2d_program_t target)
+{
+    C3D_AttrInfo* attrInfo = C3D_GetAttrInfo();
+    AttrInfo_Init(attrInfo);
+
+    if (target == PP2D_PROGRAM_SPRITES)
+    {
+        C3D_BindProgram(&spriteProgram);
+        AttrInfo_AddLoader(attrInfo, 0, GPU_FLOAT, 4);
+        AttrInfo_AddLoader(attrInfo, 1, GPU_FLOAT, 2);
+        AttrInfo_AddLoader(attrInfo, 2, GPU_FLOAT, 4);
+        AttrInfo_AddLoader(attrInfo, 3, GPU_UNSIGNED_BYTE, 4);
+    }
+    else if (target == PP2D_PROGRAM_INSTANCES)
+    {
+        C3D_BindProgram(&instanceProgram);
+        AttrInfo_AddLoader(attrInfo, 0, GPU_UNSIGNED_BYTE, 4);
+    }
+    else
+    {
+        C3D_BindProgram(&program);
+#if PP2D_COMPACT_VERTICES
+        AttrInfo_AddLoader(attrInfo, 0, GPU_SHORT, 4);
+        AttrInfo_AddLoader(attrInfo, 1, GPU_SHORT, 2);
+#else
+        AttrInfo_AddLoader(attrInfo, 0, GPU_FLOAT, 3);
+        AttrInfo_AddLoader(attrInfo, 1, GPU_FLOAT, 2);
+#endif
+        AttrInfo_AddLoader(attrInfo, 2, GPU_UNSIGNED_BYTE, 4);
+    }
+
+    currentProgram = target;
+    pp2d_bind_vbo();
+    pp2d_set_projection();
+}
+
+static void pp2d_bind_mask(u16 mask)
+{
+    const bool written = gpuState.clip.mask & PP2D_MASK_WRITE;
+    gpuState.clip.mask = mask;
+    if (mask & PP2D_MASK_WRITE)
+    {
+        // only the stencil is written, where the mask isn't transparent
+        C3D_StencilTest(true, GPU_ALWAYS, mask & 0xFF, 0xFF, 0xFF);
+        C3D_StencilOp(GPU_STENCIL_KEEP, GPU_STENCIL_KEEP, GPU_STENCIL_REPLACE);
+        C3D_AlphaTest(true, GPU_GREATER, 0);
+        C3D_DepthTest(true, GPU_ALWAYS, (GPU_WRITEMASK)0);
+        return;
+    }
+
+    if (mask & PP2D_MASK_TEST)
+    {
+        C3D_StencilTest(true, GPU_EQUAL, mask & 0xFF, 0xFF, 0);
+        C3D_StencilOp(GPU_STENCIL_KEEP, GPU_STENCIL_KEEP, GPU_STENCIL_KEEP);
+    }
+    else
+    {
+        C3D_StencilTest(false, GPU_ALWAYS, 0, 0xFF, 0);
+    }
+    if (written)
+    {
+        C3D_AlphaTest(false, GPU_ALWAYS, 0);
+        C3D_DepthTest(true, GPU_GEQUAL, GPU_WRITE_ALL);
+    }
+}
+
+static void pp2d_bind_scissor(const pp2d_clip_t* clip)
+{
+    gpuState.clip = *clip;
+    if (pp2d_same_rect(clip, &PP2D_CLIP_NONE))
+    {
+        C3D_SetScissor(GPU_SCISSOR_DISABLE, 0, 0, 0, 0);
+        return;
+    }
+
+    // targets are rotated: screen x runs along the framebuffer's height from its end, screen y along its width from its end
+    const int width = targetWidth;
+    const int left = clip->left < 0 ? 0 : (clip->left > width ? width : clip->left);
+    const int right = clip->right < left ? left : (clip->right > width ? width : clip->right);
+    const int top = clip->top < 0 ? 0 : (clip->top > PP2D_SCREEN_HEIGHT ? PP2D_SCREEN_HEIGHT : clip->top);
+    const int bottom = clip->bottom < top ? top : (clip->bottom > PP2D_SCREEN_HEIGHT ? PP2D_SCREEN_HEIGHT : clip->bottom);
+    C3D_SetScissor(GPU_SCISSOR_NORMAL, PP2D_SCREEN_HEIGHT - bottom, width - right, PP2D_SCREEN_HEIGHT - top, width - left);
+}
+
+static void pp2d_bind_texture(size_t id)
+{
+    if (geometrySprites)
+    {
+        pp2d_set_program(PP2D_PROGRAM_SPRITES);
+    }
+    else
+    {
+        pp2d_set_program(instancedSprites && !recordDraws ? PP2D_PROGRAM_INSTANCES : PP2D_PROGRAM_QUADS);
+    }
+    pp2d_set_texture(&textures[id].tex);
+    pp2d_set_env(PP2D_ENV_TEXTURE);
+    pp2d_set_clip(&currentClip);
+}
+
+static void pp2d_bind_vbo(void)
+{
+    C3D_BufInfo* bufInfo = C3D_GetBufInfo();
+    BufInfo_Init(bufInfo);
+    if (currentProgram == PP2D_PROGRAM_SPRITES)
+    {
+        BufInfo_Add(bufInfo, spriteData.vbo, sizeof(sprite_vertex_s), 4, 0x3210);
+    }
+    else if (currentProgram == PP2D_PROGRAM_INSTANCES)
+    {
+        BufInfo_Add(bufInfo, instanceVbo, 4, 1, 0x0);
+    }
+    else
+    {
+        BufInfo_Add(bufInfo, vertexData.vbo, sizeof(vertex_s), 3, 0x210);
+    }
+}
+
+static void pp2d_buffer_free(pp2d_buffer_t* buffer)
+{
+    for (size_t chunk = 0; chunk < buffer->chunkCount; chunk++)
+    {
+        linearFree(buffer->chunks[chunk]);
+    }
+    free(buffer->chunks);
+    free(buffer->frames);
+    memset(buffer, 0, sizeof(*buffer));
+}
+
+static bool pp2d_buffer_grow(pp2d_buffer_t* buffer)
+{
+    void** chunks = realloc(buffer->chunks, sizeof(void*)*(buffer->chunkCount + 1));
+    if (chunks == NULL)
+    {
+        return false;
+    }
+    buffer->chunks = chunks;
+
+    u32* frames = realloc(buffer->frames, sizeof(u32)*(buffer->chunkCount + 1));
+    if (frames == NULL)
+    {
+        return false;
+    }
+    buffer->frames = frames;
+
+    chunks[buffer->chunkCount] = linearAlloc(buffer->stride*buffer->capacity);
+    if (chunks[buffer->chunkCount] == NULL)
+    {
+        return false;
+    }
+    // a new chunk has never been used, so it counts as retired
+    frames[buffer->chunkCount] = currentFrame - 1;
+    buffer->chunkCount++;
+    return true;
+}
+
+static bool pp2d_buffer_next(pp2d_buffer_t* buffer)
+{
+    // the first chunk after the current one not used in this frame, going round them.
+    // Chunks used in this frame may still be read by commands the GPU hasn't run, so another one is allocated instead
+    for (size_t i = 1; i <= buffer->chunkCount; i++)
+    {
+        const size_t chunk = (buffer->chunk + i) % buffer->chunkCount;
+        if (buffer->frames[chunk] != currentFrame)
+        {
+            pp2d_buffer_rewind(buffer, chunk);
+            return true;
+        }
+    }
+
+    if (!pp2d_buffer_grow(buffer))
+    {
+        return false;
+    }
+    pp2d_buffer_rewind(buffer, buffer->chunkCount - 1);
+    return true;
+}
+
+static bool pp2d_buffer_reserve(pp2d_buffer_t* buffer, size_t count)
+{
+    if (buffer->cur + count <= buffer->capacity)
+    {
+        return true;
+    }
+
+    // the chunk is full: draw it and carry on in the next free one, allocated when none is.
+    // Submitting the commands queued so far lets the GPU read this chunk while the next one is filled
+    pp2d_draw_unprocessed_queue();
+    if (!recordDraws)
+    {
+        C3D_FrameSplit(0);
+    }
+    return pp2d_buffer_next(buffer);
+}
+
+static void pp2d_buffer_rewind(pp2d_buffer_t* buffer, size_t chunk)
+{
+    void* vbo = chunk < buffer->chunkCount ? buffer->chunks[chunk] : NULL;
+    buffer->chunk = chunk;
+    buffer->cur = 0;
+    buffer->old = 0;
+    if (vbo != NULL)
+    {
+        buffer->frames[chunk] = currentFrame;
+    }
+    if (vbo != buffer->vbo)
+    {
+        buffer->vbo = vbo;
+        if (buffer == (currentProgram == PP2D_PROGRAM_SPRITES ? &spriteData : &vertexData))
+        {
+            pp2d_bind_vbo();
+        }
+    }
+}
+
+#if PP2D_COMPACT_VERTICES
+static inline s16 pp2d_compact(float value, float one)
+{
+    float fixed = value*one;
+    fixed = fixed > 32767.0f ? 32767.0f : fixed;
+    fixed = fixed < -32767.0f ? -32767.0f : fixed;
+    return (s16)(fixed < 0 ? fixed - 0.5f : fixed + 0.5f);
+}
+#endif
+
+static inline bool pp2d_culled(float left, float top, float right, float bottom)
+{
+    return right <= cullBounds[0] || bottom <= cullBounds[1] || left >= cullBounds[2] || top >= cullBounds[3];
+}
+
+static inline bool pp2d_culled_sprite(float x, float y, float width, float height, float angle)
+{
+    if (angle == 0)
+    {
+        // scales can be negative
+        return pp2d_culled(width < 0 ? x + width : x, height < 0 ? y + height : y, width < 0 ? x : x + width, height < 0 ? y : y + height);
+    }
+
+    // any rotation stays within the circle through the corners
+    const float radius = (fabsf(width) + fabsf(height))/2.0f;
+    const float xcenter = x + width/2.0f;
+    const float ycenter = y + height/2.0f;
+    return pp2d_culled(xcenter - radius, ycenter - radius, xcenter + radius, ycenter + radius);
 }
 
 void pp2d_draw_arrays(void)
 {
+#if PP2D_INDEXED_QUADS
+    const size_t quads = (vertexData.cur - vertexData.old) / 4;
+    C3D_DrawElements(GPU_TRIANGLES, quads*6, C3D_UNSIGNED_SHORT, &quadIndices[vertexData.old/4*6]);
+#else
     C3D_DrawArrays(GPU_TRIANGLES, vertexData.old, vertexData.cur - vertexData.old);
+#endif
     vertexData.old = vertexData.cur;
 }
 
-void pp2d_draw_rectangle(int x, int y, int width, int height, u32 color)
+static void pp2d_draw_batch(const pp2d_draw_item_t* state, size_t first, size_t count)
 {
-    pp2d_draw_unprocessed_queue();
+    pp2d_set_program(state->program);
+    if (state->texture != NULL)
+    {
+        pp2d_set_texture(state->texture);
+    }
+    pp2d_set_env(state->env);
+    pp2d_set_clip(&state->clip);
+
+    const bool sprites = state->program == PP2D_PROGRAM_SPRITES;
+    pp2d_buffer_rewind(sprites ? &spriteData : &vertexData, state->chunk);
+    C3D_DrawElements(sprites ? GPU_GEOMETRY_PRIM : GPU_TRIANGLES, count, C3D_UNSIGNED_SHORT, &((u16*)indexData.vbo)[first]);
+}
+
+static void pp2d_draw_instances(void)
+{
+    for (int i = 0; i < 4; i++)
+    {
+        C3D_FVec* uniforms = C3D_FVUnifWritePtr(GPU_VERTEX_SHADER, uLoc_instances[i], instanceCount);
+        memcpy(uniforms, instanceData[i], sizeof(C3D_FVec)*instanceCount);
+    }
+
+#if PP2D_INDEXED_QUADS
+    C3D_DrawElements(GPU_TRIANGLES, instanceCount*6, C3D_UNSIGNED_SHORT, quadIndices);
+#else
+    C3D_DrawArrays(GPU_TRIANGLES, 0, instanceCount*6);
+#endif
+    instanceCount = 0;
+}
+
+static void pp2d_draw_list_free(pp2d_draw_list_t* list)
+{
+    free(list->items);
+    free(list->keys);
+    free(list->scratch);
+    free(list->batches);
+    free(list->next);
+    memset(list, 0, sizeof(*list));
+}
 
-    if (vertexData.cur + 6 > PP2D_MAX_VERTICES)
+static void pp2d_draw_recorded(void)
+{
+    if (!recordDraws)
     {
         return;
     }
 
-    if (color != prevColor || renderedText || renderedTexture)
+    pp2d_record_run();
+    if (drawList.count == 0 || discardDraws)
     {
-        prevColor = color;
-        C3D_TexEnv* env = C3D_GetTexEnv(0);
-        C3D_TexEnvSrc(env, C3D_Both, GPU_CONSTANT, GPU_CONSTANT, 0);
-        C3D_TexEnvOp(env, C3D_Both, 0, 0, 0);
-        C3D_TexEnvFunc(env, C3D_RGB, GPU_INTERPOLATE);
-        C3D_TexEnvColor(env, color);
+        drawList.count = 0;
+        return;
+    }
+
+    if (sortDraws || opaquePass)
+    {
+        pp2d_sort_draws();
+    }
+    else
+    {
+        pp2d_merge_draws();
+    }
+
+    if (indexData.chunkCount == 0)
+    {
+        if (!pp2d_buffer_grow(&indexData))
+        {
+            drawList.count = 0;
+            return;
+        }
+        pp2d_buffer_rewind(&indexData, 0);
+    }
+
+    // replay with the real state, then continue recording where it stopped
+    const size_t vertexChunk = vertexData.chunk;
+    const size_t vertexCur = vertexData.cur;
+    const size_t spriteChunk = spriteData.chunk;
+    const size_t spriteCur = spriteData.cur;
+    recordDraws = false;
+
+    // runs sharing state and vertex chunk are drawn together through an index list
+    const pp2d_draw_item_t* batch = NULL;
+    for (size_t i = 0; i < drawList.count; i++)
+    {
+        const pp2d_draw_item_t* item = &drawList.items[drawList.keys[i].item];
+        const bool quads = item->program == PP2D_PROGRAM_QUADS && PP2D_INDEXED_QUADS;
+        const size_t indices = quads ? item->count/4*6 : item->count;
+
+        const bool sameBatch = batch != NULL && batch->program == item->program && batch->texture == item->texture
+            && batch->env == item->env && batch->chunk == item->chunk && pp2d_same_clip(&batch->clip, &item->clip);
+        if (batch != NULL && (!sameBatch || indexData.cur + indices > indexData.capacity))
+        {
+            pp2d_draw_batch(batch, indexData.old, indexData.cur - indexData.old);
+            indexData.old = indexData.cur;
+        }
+        batch = item;
+
+        if (indexData.cur + indices > indexData.capacity)
+        {
+            if (!pp2d_buffer_next(&indexData))
+            {
+                break;
+            }
+        }
+
+        u16* idx = &((u16*)indexData.vbo)[indexData.cur];
+        if (quads)
+        {
+            for (u32 quad = item->first; quad < item->first + item->count; quad += 4)
+            {
+                idx[0] = quad;
+                idx[1] = quad + 1;
+                idx[2] = quad + 2;
+                idx[3] = quad + 2;
+                idx[4] = quad + 1;
+                idx[5] = quad + 3;
+                idx += 6;
+            }
+        }
+        else
+        {
+            for (u32 vertex = item->first; vertex < item->first + item->count; vertex++)
+            {
+                *idx++ = vertex;
+            }
+        }
+        indexData.cur += indices;
+    }
+
+    if (batch != NULL && indexData.cur != indexData.old)
+    {
+        pp2d_draw_batch(batch, indexData.old, indexData.cur - indexData.old);
+        indexData.old = indexData.cur;
+    }
+
+    pp2d_buffer_rewind(&vertexData, vertexChunk);
+    vertexData.cur = vertexData.old = vertexCur;
+    pp2d_buffer_rewind(&spriteData, spriteChunk);
+    spriteData.cur = spriteData.old = spriteCur;
+
+    recordDraws = true;
+    drawList.count = 0;
+}
+
+void pp2d_draw_rectangle(int x, int y, int width, int height, u32 color)
+{
+    if (pp2d_culled_sprite(x, y, width, height, 0))
+    {
+        stateStats.rectanglesCulled++;
+        return;
     }
 
-    pp2d_add_text_vertex(        x,          y, PP2D_DEFAULT_DEPTH, 0, 0);
-    pp2d_add_text_vertex(        x, y + height, PP2D_DEFAULT_DEPTH, 0, 0);
-    pp2d_add_text_vertex(x + width,          y, PP2D_DEFAULT_DEPTH, 0, 0);
-    pp2d_add_text_vertex(x + width,          y, PP2D_DEFAULT_DEPTH, 0, 0);
-    pp2d_add_text_vertex(        x, y + height, PP2D_DEFAULT_DEPTH, 0, 0);
-    pp2d_add_text_vertex(x + width, y + height, PP2D_DEFAULT_DEPTH, 0, 0);
-    pp2d_draw_arrays();
+    // the color travels with the vertices, so consecutive rectangles share a single draw
+    pp2d_set_program(PP2D_PROGRAM_QUADS);
+    pp2d_set_env(PP2D_ENV_RECTANGLE);
+    pp2d_set_clip(&currentClip);
 
-    pp2d_set_rendered_flags(false, false, true);
+    const float vert[4][2] = {
+        {        x,          y},
+        {        x, y + height},
+        {x + width,          y},
+        {x + width, y + height},
+    };
+    pp2d_add_quad(vert, PP2D_DEFAULT_DEPTH, 0, 0, 0, 0, color);
 }
 
 void pp2d_draw_text(float x, float y, float scaleX, float scaleY, u32 color, const char* text)
@@ -156,6 +993,43 @@ void pp2d_draw_text_center(gfxScreen_t target, float y, float scaleX, float scal
     pp2d_draw_text(x, y, scaleX, scaleY, color, text);
 }
 
+void pp2d_draw_text_deferred(void)
+{
+    if (deferredCount == 0)
+    {
+        return;
+    }
+
+    // counting sort by glyph sheet, keeping the submission order inside each sheet
+    const int nSheets = fontGetGlyphInfo()->nSheets;
+    memset(deferredSheetStart, 0, sizeof(u32)*(nSheets + 1));
+    for (size_t i = 0; i < deferredCount; i++)
+    {
+        deferredSheetStart[deferredGlyphs[i].data.sheetIndex + 1]++;
+    }
+    for (int sheet = 0; sheet < nSheets; sheet++)
+    {
+        deferredSheetStart[sheet + 1] += deferredSheetStart[sheet];
+    }
+    for (size_t i = 0; i < deferredCount; i++)
+    {
+        deferredOrder[deferredSheetStart[deferredGlyphs[i].data.sheetIndex]++] = i;
+    }
+
+    pp2d_set_program(PP2D_PROGRAM_QUADS);
+    pp2d_set_env(PP2D_ENV_TEXT);
+
+    for (size_t i = 0; i < deferredCount; i++)
+    {
+        // glyphs keep the clip they were drawn with
+        const size_t glyph = deferredOrder[i];
+        pp2d_set_clip(&deferredGlyphs[glyph].clip);
+        pp2d_add_glyph(deferredGlyphs[glyph].x, deferredGlyphs[glyph].y, &deferredGlyphs[glyph].data, deferredGlyphs[glyph].color);
+    }
+
+    deferredCount = 0;
+}
+
 void pp2d_draw_text_wrap(float x, float y, float scaleX, float scaleY, u32 color, float wrapX, const char* text)
 {
     if (text == NULL)
@@ -163,8 +1037,9 @@ void pp2d_draw_text_wrap(float x, float y, float scaleX, float scaleY, u32 color
         return;
     }
 
-    pp2d_draw_unprocessed_queue();
-
+    // glyphs carry their color, so text only flushes when switching primitive or glyph sheet.
+    // The state is set by the first glyph on the target, so text out of it doesn't break the batch
+    bool textEnv = deferredText;
     ssize_t  units;
     uint32_t code;
     const uint8_t* p = (const uint8_t*)text;
@@ -195,40 +1070,43 @@ void pp2d_draw_text_wrap(float x, float y, float scaleX, float scaleY, u32 color
         }
         else if (code > 0)
         {
-            if (vertexData.cur + 6 > PP2D_MAX_VERTICES)  
+            if (deferredText && deferredCount == PP2D_MAX_DEFERRED_GLYPHS)
             {
-                break;
+                pp2d_draw_text_deferred();
             }
             
             int glyphIdx = fontGlyphIndexFromCodePoint(code);
             fontGlyphPos_s data;
             fontCalcGlyphPos(&data, glyphIdx, GLYPH_POS_CALC_VTXCOORD, scaleX, scaleY);
 
-            if (data.sheetIndex != lastSheet)
+            if (pp2d_culled(x + data.vtxcoord.left, y + data.vtxcoord.top, x + data.vtxcoord.right, y + data.vtxcoord.bottom))
             {
-                lastSheet = data.sheetIndex;
-                C3D_TexBind(0, &glyphSheets[lastSheet]);
+                stateStats.glyphsCulled++;
             }
-
-            if (color != prevColor || renderedRectangle || renderedTexture)
+            else if (deferredText)
             {
-                prevColor = color;
-                pp2d_set_text_color(color);
+                deferredGlyphs[deferredCount].x = x;
+                deferredGlyphs[deferredCount].y = y;
+                deferredGlyphs[deferredCount].data = data;
+                deferredGlyphs[deferredCount].color = color;
+                deferredGlyphs[deferredCount].clip = currentClip;
+                deferredCount++;
+            }
+            else
+            {
+                if (!textEnv)
+                {
+                    pp2d_set_program(PP2D_PROGRAM_QUADS);
+                    pp2d_set_env(PP2D_ENV_TEXT);
+                    pp2d_set_clip(&currentClip);
+                    textEnv = true;
+                }
+                pp2d_add_glyph(x, y, &data, color);
             }
-
-            pp2d_add_text_vertex(x+data.vtxcoord.left,  y+data.vtxcoord.top,    PP2D_DEFAULT_DEPTH, data.texcoord.left,  data.texcoord.top);
-            pp2d_add_text_vertex(x+data.vtxcoord.left,  y+data.vtxcoord.bottom, PP2D_DEFAULT_DEPTH, data.texcoord.left,  data.texcoord.bottom);
-            pp2d_add_text_vertex(x+data.vtxcoord.right, y+data.vtxcoord.top,    PP2D_DEFAULT_DEPTH, data.texcoord.right, data.texcoord.top);
-            pp2d_add_text_vertex(x+data.vtxcoord.right, y+data.vtxcoord.top,    PP2D_DEFAULT_DEPTH, data.texcoord.right, data.texcoord.top);
-            pp2d_add_text_vertex(x+data.vtxcoord.left,  y+data.vtxcoord.bottom, PP2D_DEFAULT_DEPTH, data.texcoord.left,  data.texcoord.bottom);
-            pp2d_add_text_vertex(x+data.vtxcoord.right, y+data.vtxcoord.bottom, PP2D_DEFAULT_DEPTH, data.texcoord.right, data.texcoord.bottom);
-            pp2d_draw_arrays();
 
             x += data.xAdvance;
         }
     } while (code > 0);
-
-    pp2d_set_rendered_flags(false, true, false);
 }
 
 void pp2d_draw_textf(float x, float y, float scaleX, float scaleY, u32 color, const char* text, ...) 
@@ -243,12 +1121,273 @@ void pp2d_draw_textf(float x, float y, float scaleX, float scaleY, u32 color, co
 
 static void pp2d_draw_unprocessed_queue(void)
 {
-    if (vertexData.cur != vertexData.old)
+    // while recording, the pending vertices become a run to replay later
+    if (recordDraws)
+    {
+        pp2d_record_run();
+        return;
+    }
+
+    // nothing reaches a screen marked unchanged
+    if (discardDraws)
+    {
+        spriteData.old = spriteData.cur;
+        vertexData.old = vertexData.cur;
+        instanceCount = 0;
+        return;
+    }
+
+    if (spriteData.cur != spriteData.old)
+    {
+        C3D_DrawArrays(GPU_GEOMETRY_PRIM, spriteData.old, spriteData.cur - spriteData.old);
+        spriteData.old = spriteData.cur;
+    }
+
+    if (instanceCount > 0)
+    {
+        pp2d_draw_instances();
+    }
+
+    if (vertexData.cur != vertexData.old)
     {
         pp2d_draw_arrays();
     }
 }
 
+void pp2d_emitter_create(size_t id, size_t texture, size_t capacity, const pp2d_emitter_s* settings)
+{
+    if (id >= PP2D_MAX_EMITTERS || texture >= PP2D_MAX_TEXTURES || capacity == 0 || settings == NULL)
+    {
+        return;
+    }
+
+    pp2d_emitter_free(id);
+    pp2d_emitter_t* emitter = &emitters[id];
+    float* data = malloc(sizeof(float)*capacity*6);
+    if (data == NULL)
+    {
+        return;
+    }
+
+    emitter->x = data;
+    emitter->y = data + capacity;
+    emitter->velocityX = data + capacity*2;
+    emitter->velocityY = data + capacity*3;
+    emitter->age = data + capacity*4;
+    emitter->aging = data + capacity*5;
+    emitter->capacity = capacity;
+    emitter->texture = texture;
+    emitter->settings = *settings;
+    emitter->seed = 0x9E3779B9 + id;
+}
+
+void pp2d_emitter_draw(size_t id)
+{
+    if (id >= PP2D_MAX_EMITTERS || emitters[id].count == 0)
+    {
+        return;
+    }
+
+    // the whole emitter is culled at once, grown by the biggest particle
+    const pp2d_emitter_t* emitter = &emitters[id];
+    const pp2d_emitter_s* settings = &emitter->settings;
+    const float half = fmaxf(fabsf(settings->startSize), fabsf(settings->endSize))/2.0f;
+    const float bounds[4] = { emitter->bounds[0] - half, emitter->bounds[1] - half, emitter->bounds[2] + half, emitter->bounds[3] + half };
+    if (pp2d_culled(bounds[0], bounds[1], bounds[2], bounds[3]))
+    {
+        stateStats.spritesCulled += emitter->count;
+        return;
+    }
+
+    pp2d_set_program(PP2D_PROGRAM_QUADS);
+    pp2d_set_texture(&textures[emitter->texture].tex);
+    pp2d_set_env(PP2D_ENV_TEXTURE);
+    pp2d_set_clip(&currentClip);
+
+    const float invWidth = 1.0f / textures[emitter->texture].tex.width;
+    const float invHeight = 1.0f / textures[emitter->texture].tex.height;
+    const float left = settings->xbegin * invWidth;
+    const float right = (settings->xbegin + settings->width) * invWidth;
+    const float top = 1.0f - settings->ybegin * invHeight;
+    const float bottom = 1.0f - (settings->ybegin + settings->height) * invHeight;
+    const float depth = pp2d_record_depth(PP2D_DEFAULT_DEPTH);
+
+    // particles are written straight into the vertex buffer, as many as the current chunk holds at a time
+    for (size_t first = 0; first < emitter->count; )
+    {
+        if (!pp2d_buffer_reserve(&vertexData, PP2D_QUAD_VERTICES))
+        {
+            return;
+        }
+        if (recordDraws)
+        {
+            pp2d_record_bounds(bounds[0], bounds[1], bounds[2], bounds[3]);
+        }
+
+        const size_t room = (vertexData.capacity - vertexData.cur) / PP2D_QUAD_VERTICES;
+        const size_t count = emitter->count - first < room ? emitter->count - first : room;
+        pp2d_emitter_write(&((vertex_s*)vertexData.vbo)[vertexData.cur], emitter, first, count, depth, left, top, right, bottom);
+        vertexData.cur += count*PP2D_QUAD_VERTICES;
+        first += count;
+    }
+}
+
+void pp2d_emitter_emit(size_t id, size_t count)
+{
+    if (id >= PP2D_MAX_EMITTERS || emitters[id].x == NULL)
+    {
+        return;
+    }
+
+    pp2d_emitter_t* emitter = &emitters[id];
+    const pp2d_emitter_s* settings = &emitter->settings;
+    count = count < emitter->capacity - emitter->count ? count : emitter->capacity - emitter->count;
+    if (count == 0)
+    {
+        return;
+    }
+
+    for (size_t i = emitter->count; i < emitter->count + count; i++)
+    {
+        emitter->x[i] = settings->x + settings->spreadX*pp2d_random(&emitter->seed);
+        emitter->y[i] = settings->y + settings->spreadY*pp2d_random(&emitter->seed);
+        emitter->velocityX[i] = settings->velocityX + settings->velocitySpread*pp2d_random(&emitter->seed);
+        emitter->velocityY[i] = settings->velocityY + settings->velocitySpread*pp2d_random(&emitter->seed);
+        emitter->age[i] = 0;
+        const float lifetime = settings->lifetime + settings->lifetimeSpread*pp2d_random(&emitter->seed);
+        emitter->aging[i] = lifetime > 0.001f ? 1.0f/lifetime : 1000.0f;
+    }
+
+    if (emitter->count == 0)
+    {
+        emitter->bounds[0] = emitter->bounds[1] = INFINITY;
+        emitter->bounds[2] = emitter->bounds[3] = -INFINITY;
+    }
+    emitter->bounds[0] = fminf(emitter->bounds[0], settings->x - fabsf(settings->spreadX));
+    emitter->bounds[1] = fminf(emitter->bounds[1], settings->y - fabsf(settings->spreadY));
+    emitter->bounds[2] = fmaxf(emitter->bounds[2], settings->x + fabsf(settings->spreadX));
+    emitter->bounds[3] = fmaxf(emitter->bounds[3], settings->y + fabsf(settings->spreadY));
+    emitter->count += count;
+}
+
+void pp2d_emitter_free(size_t id)
+{
+    if (id >= PP2D_MAX_EMITTERS)
+    {
+        return;
+    }
+
+    free(emitters[id].x);
+    memset(&emitters[id], 0, sizeof(emitters[id]));
+}
+
+size_t pp2d_emitter_get_count(size_t id)
+{
+    return id < PP2D_MAX_EMITTERS ? emitters[id].count : 0;
+}
+
+static void pp2d_emitter_move(float* restrict x, float* restrict y, float* restrict velocityX, float* restrict velocityY, float* restrict age, const float* restrict aging, size_t count, float accelerationX, float accelerationY, float seconds)
+{
+    // no branches and one particle per iteration, so the compiler can unroll or vectorize it
+    for (size_t i = 0; i < count; i++)
+    {
+        velocityX[i] += accelerationX;
+        velocityY[i] += accelerationY;
+        x[i] += velocityX[i]*seconds;
+        y[i] += velocityY[i]*seconds;
+        age[i] += aging[i]*seconds;
+    }
+}
+
+void pp2d_emitter_set(size_t id, const pp2d_emitter_s* settings)
+{
+    if (id >= PP2D_MAX_EMITTERS || emitters[id].x == NULL || settings == NULL)
+    {
+        return;
+    }
+    emitters[id].settings = *settings;
+}
+
+void pp2d_emitter_update(size_t id, float seconds)
+{
+    if (id >= PP2D_MAX_EMITTERS || emitters[id].count == 0)
+    {
+        return;
+    }
+
+    pp2d_emitter_t* emitter = &emitters[id];
+    pp2d_emitter_move(emitter->x, emitter->y, emitter->velocityX, emitter->velocityY, emitter->age, emitter->aging, emitter->count,
+        emitter->settings.accelerationX*seconds, emitter->settings.accelerationY*seconds, seconds);
+
+    // the last particle takes the place of a dead one, the order particles are drawn in doesn't show
+    size_t count = emitter->count;
+    for (size_t i = 0; i < count; )
+    {
+        if (emitter->age[i] < 1.0f)
+        {
+            i++;
+            continue;
+        }
+
+        count--;
+        emitter->x[i] = emitter->x[count];
+        emitter->y[i] = emitter->y[count];
+        emitter->velocityX[i] = emitter->velocityX[count];
+        emitter->velocityY[i] = emitter->velocityY[count];
+        emitter->age[i] = emitter->age[count];
+        emitter->aging[i] = emitter->aging[count];
+    }
+    emitter->count = count;
+
+    float left = INFINITY, top = INFINITY, right = -INFINITY, bottom = -INFINITY;
+    for (size_t i = 0; i < count; i++)
+    {
+        left = emitter->x[i] < left ? emitter->x[i] : left;
+        top = emitter->y[i] < top ? emitter->y[i] : top;
+        right = emitter->x[i] > right ? emitter->x[i] : right;
+        bottom = emitter->y[i] > bottom ? emitter->y[i] : bottom;
+    }
+    emitter->bounds[0] = left;
+    emitter->bounds[1] = top;
+    emitter->bounds[2] = right;
+    emitter->bounds[3] = bottom;
+}
+
+static void pp2d_emitter_write(vertex_s* restrict vertices, const pp2d_emitter_t* emitter, size_t first, size_t count, float depth, float left, float top, float right, float bottom)
+{
+    const pp2d_emitter_s* settings = &emitter->settings;
+    const float* restrict x = emitter->x + first;
+    const float* restrict y = emitter->y + first;
+    const float* restrict age = emitter->age + first;
+    const float startHalf = settings->startSize/2.0f;
+    const float growth = (settings->endSize - settings->startSize)/2.0f;
+
+    // colors fade two channels at a time, red and blue then green and alpha, by the age in 256ths
+    const u32 startRB = settings->startColor & 0x00FF00FF;
+    const u32 startGA = (settings->startColor >> 8) & 0x00FF00FF;
+    const u32 endRB = settings->endColor & 0x00FF00FF;
+    const u32 endGA = (settings->endColor >> 8) & 0x00FF00FF;
+
+    for (size_t i = 0; i < count; i++)
+    {
+        const float half = startHalf + growth*age[i];
+        const u32 fade = (u32)(age[i]*256.0f);
+        const u32 color = (((startRB*(256 - fade) + endRB*fade) >> 8) & 0x00FF00FF) | ((startGA*(256 - fade) + endGA*fade) & 0xFF00FF00);
+
+        vertex_s* vtx = &vertices[i*PP2D_QUAD_VERTICES];
+        pp2d_write_vertex(&vtx[0], x[i] - half, y[i] - half, depth, left, top, color);
+        pp2d_write_vertex(&vtx[1], x[i] - half, y[i] + half, depth, left, bottom, color);
+        pp2d_write_vertex(&vtx[2], x[i] + half, y[i] - half, depth, right, top, color);
+#if PP2D_INDEXED_QUADS
+        pp2d_write_vertex(&vtx[3], x[i] + half, y[i] + half, depth, right, bottom, color);
+#else
+        vtx[3] = vtx[2];
+        vtx[4] = vtx[1];
+        pp2d_write_vertex(&vtx[5], x[i] + half, y[i] + half, depth, right, bottom, color);
+#endif
+    }
+}
+
 void pp2d_exit(void)
 {
     for (size_t id = 0; id < PP2D_MAX_TEXTURES; id++)
@@ -256,11 +1395,44 @@ void pp2d_exit(void)
         pp2d_free_texture(id);
     }
     
-    linearFree(vertexData.vbo);
+    pp2d_buffer_free(&vertexData);
+#if PP2D_INDEXED_QUADS
+    linearFree(quadIndices);
+#endif
     free(glyphSheets);
+    free(deferredGlyphs);
+    free(deferredOrder);
+    free(deferredSheetStart);
     
+    pp2d_buffer_free(&spriteData);
+    for (size_t id = 0; id < PP2D_MAX_STATIC_LAYERS; id++)
+    {
+        pp2d_static_layer_free(id);
+    }
+    for (size_t id = 0; id < PP2D_MAX_TILEMAPS; id++)
+    {
+        pp2d_tilemap_free(id);
+    }
+    for (size_t id = 0; id < PP2D_MAX_EMITTERS; id++)
+    {
+        pp2d_emitter_free(id);
+    }
+    pp2d_draw_list_free(&drawList);
+    recordDraws = false;
+    sortDraws = false;
+    mergeDraws = false;
+    opaquePass = false;
+    pp2d_buffer_free(&indexData);
+    linearFree(instanceVbo);
+    instanceCount = 0;
+    instancedSprites = false;
+
     shaderProgramFree(&program);
     DVLB_Free(vshader_dvlb);
+    shaderProgramFree(&spriteProgram);
+    DVLB_Free(sprite_dvlb);
+    shaderProgramFree(&instanceProgram);
+    DVLB_Free(instance_dvlb);
     
     C3D_Fini();
     gfxExit();
@@ -269,31 +1441,84 @@ void pp2d_exit(void)
 void pp2d_frame_begin(gfxScreen_t target, gfx3dSide_t side)
 {
     C3D_FrameBegin(C3D_FRAME_SYNCDRAW);
-    vertexData.cur = 0;
-    vertexData.old = 0;
+    // the GPU is done with the previous frame's command list once C3D_FrameBegin returns, so every chunk is free again
+    currentFrame++;
+    pp2d_buffer_rewind(&vertexData, 0);
+    pp2d_buffer_rewind(&spriteData, 0);
+    pp2d_buffer_rewind(&indexData, 0);
+    maskRef = 0;
     pp2d_frame_draw_on(target, side);
 }
 
 void pp2d_frame_draw_on(gfxScreen_t target, gfx3dSide_t side)
 {
+    pp2d_draw_text_deferred();
+    pp2d_draw_recorded();
     pp2d_draw_unprocessed_queue();
     
+    // clip rects and masks belong to the target they were set on, and the scissor maps them to its framebuffer
+    clipDepth = 0;
+    clipOverflow = 0;
+    currentClip = PP2D_CLIP_NONE;
+    if (gpuState.clip.mask != 0)
+    {
+        stateStats.stencilChanges++;
+        pp2d_bind_mask(0);
+    }
+    if (!pp2d_same_clip(&gpuState.clip, &PP2D_CLIP_NONE))
+    {
+        stateStats.scissorChanges++;
+        pp2d_bind_scissor(&PP2D_CLIP_NONE);
+    }
+
+    // an unchanged screen is neither cleared nor drawn on once both framebuffers show its picture
+    discardDraws = unchangedScreens[target] && unchangedRedraws[target] == 0;
+    drawnScreens[target] |= !discardDraws;
     if (target == GFX_TOP)
     {
-        C3D_FrameDrawOn(side == GFX_LEFT ? topLeft : topRight);
-        C3D_FVUnifMtx4x4(GPU_VERTEX_SHADER, uLoc_projection, side == GFX_LEFT ? &projectionTopLeft : &projectionTopRight);
+        if (!discardDraws)
+        {
+            C3D_FrameDrawOn(side == GFX_LEFT ? topLeft : topRight);
+        }
+        targetProjection = side == GFX_LEFT ? &projectionTopLeft : &projectionTopRight;
+        targetWidth = PP2D_SCREEN_TOP_WIDTH;
+        cullBounds[2] = PP2D_SCREEN_TOP_WIDTH;
     } 
     else
     {
-        C3D_FrameDrawOn(bot);
-        C3D_FVUnifMtx4x4(GPU_VERTEX_SHADER, uLoc_projection, &projectionBot);
+        if (!discardDraws)
+        {
+            C3D_FrameDrawOn(bot);
+        }
+        targetProjection = &projectionBot;
+        targetWidth = PP2D_SCREEN_BOTTOM_WIDTH;
+        cullBounds[2] = PP2D_SCREEN_BOTTOM_WIDTH;
     }
+    cullBounds[0] = 0;
+    cullBounds[1] = 0;
+    cullBounds[3] = PP2D_SCREEN_HEIGHT;
+
+    // only the bound program gets the projection now, the other one gets it when it's bound
+    pp2d_set_projection();
 }
 
 void pp2d_frame_end(void)
 {
+    pp2d_draw_text_deferred();
+    pp2d_draw_recorded();
     pp2d_draw_unprocessed_queue();
+    discardDraws = false;
     C3D_FrameEnd(0);
+
+    // screens done redrawing are unlinked, so they don't get display transfers either
+    for (int screen = GFX_TOP; screen <= GFX_BOTTOM; screen++)
+    {
+        if (unchangedScreens[screen] && drawnScreens[screen] && --unchangedRedraws[screen] == 0)
+        {
+            pp2d_set_screen_output(screen, false);
+        }
+        drawnScreens[screen] = false;
+    }
 }
 
 void pp2d_free_texture(size_t id)
@@ -308,12 +1533,22 @@ void pp2d_free_texture(size_t id)
         return;
     }
     
+    if (gpuState.texture == &textures[id].tex)
+    {
+        pp2d_draw_unprocessed_queue();
+        gpuState.texture = NULL;
+    }
     C3D_TexDelete(&textures[id].tex);
     textures[id].width = 0;
     textures[id].height = 0;
     textures[id].allocated = false;
 }
 
+void pp2d_get_state_stats(pp2d_state_stats_s* stats)
+{
+    *stats = stateStats;
+}
+
 float pp2d_get_text_height(const char* text, float scaleX, float scaleY)
 {
     float height;
@@ -401,6 +1636,11 @@ float pp2d_get_text_width(const char* text, float scaleX, float scaleY)
 }
 
 void pp2d_init(void)
+{
+    pp2d_init_with_capacity(PP2D_MAX_VERTICES);
+}
+
+void pp2d_init_with_capacity(size_t vertices)
 {
     gfxInitDefault();
     C3D_Init(C3D_DEFAULT_CMDBUF_SIZE);
@@ -422,13 +1662,29 @@ void pp2d_init(void)
     vshader_dvlb = DVLB_ParseFile((u32*)vshader_shbin, vshader_shbin_size);
     shaderProgramInit(&program);
     shaderProgramSetVsh(&program, &vshader_dvlb->DVLE[0]);
-    C3D_BindProgram(&program);
     uLoc_projection = shaderInstanceGetUniformLocation(program.vertexShader, "projection");
-    
-    C3D_AttrInfo* attrInfo = C3D_GetAttrInfo();
-    AttrInfo_Init(attrInfo);
-    AttrInfo_AddLoader(attrInfo, 0, GPU_FLOAT, 3);
-    AttrInfo_AddLoader(attrInfo, 1, GPU_FLOAT, 2);
+    uLoc_attrScale = shaderInstanceGetUniformLocation(program.vertexShader, "attrscale");
+
+    sprite_dvlb = DVLB_ParseFile((u32*)sprite_shbin, sprite_shbin_size);
+    shaderProgramInit(&spriteProgram);
+    shaderProgramSetVsh(&spriteProgram, &sprite_dvlb->DVLE[0]);
+    shaderProgramSetGsh(&spriteProgram, &sprite_dvlb->DVLE[1], 4);
+    uLoc_spriteProjection = shaderInstanceGetUniformLocation(spriteProgram.geometryShader, "projection");
+
+    instance_dvlb = DVLB_ParseFile((u32*)instance_shbin, instance_shbin_size);
+    shaderProgramInit(&instanceProgram);
+    shaderProgramSetVsh(&instanceProgram, &instance_dvlb->DVLE[0]);
+    uLoc_instanceProjection = shaderInstanceGetUniformLocation(instanceProgram.vertexShader, "projection");
+    uLoc_instances[PP2D_INSTANCE_CENTER] = shaderInstanceGetUniformLocation(instanceProgram.vertexShader, "center");
+    uLoc_instances[PP2D_INSTANCE_AXIS] = shaderInstanceGetUniformLocation(instanceProgram.vertexShader, "axis");
+    uLoc_instances[PP2D_INSTANCE_TEXRECT] = shaderInstanceGetUniformLocation(instanceProgram.vertexShader, "texrect");
+    uLoc_instances[PP2D_INSTANCE_TINT] = shaderInstanceGetUniformLocation(instanceProgram.vertexShader, "tint");
+
+#if PP2D_COMPACT_VERTICES
+    C3D_FVUnifSet(GPU_VERTEX_SHADER, uLoc_attrScale, 1.0f/PP2D_COMPACT_POSITION_ONE, 1.0f/PP2D_COMPACT_UNIT_ONE, 1.0f/PP2D_COMPACT_UNIT_ONE, 1.0f);
+#else
+    C3D_FVUnifSet(GPU_VERTEX_SHADER, uLoc_attrScale, 1.0f, 1.0f, 1.0f, 1.0f);
+#endif
 
     Mtx_OrthoTilt(&projectionTopLeft, 0, PP2D_SCREEN_TOP_WIDTH, PP2D_SCREEN_HEIGHT, 0.0f, 0.0f, 1.0f, true);
     Mtx_OrthoTilt(&projectionTopRight, 0, PP2D_SCREEN_TOP_WIDTH, PP2D_SCREEN_HEIGHT, 0.0f, 0.0f, 1.0f, true);
@@ -453,21 +1709,103 @@ void pp2d_init(void)
         tex->lodParam = 0;
     }
 
+    deferredGlyphs = malloc(sizeof(*deferredGlyphs)*PP2D_MAX_DEFERRED_GLYPHS);
+    deferredOrder = malloc(sizeof(u16)*PP2D_MAX_DEFERRED_GLYPHS);
+    deferredSheetStart = malloc(sizeof(u32)*(glyphInfo->nSheets + 1));
+    deferredCount = 0;
+    deferredText = false;
+
     charWidthInfo_s* cwi = fontGetCharWidthInfo(fontGlyphIndexFromCodePoint(0x3042));
     s_textScale = 20.0f / (cwi->glyphWidth); // 20 is glyphWidth in J machines
 
-    vertexData.vbo = (vertex_s*)linearAlloc(sizeof(vertex_s)*PP2D_MAX_VERTICES);
-    C3D_BufInfo* bufInfo = C3D_GetBufInfo();
-    BufInfo_Init(bufInfo);
-    BufInfo_Add(bufInfo, vertexData.vbo, sizeof(vertex_s), 2, 0x10);
+#if PP2D_LUT_ROTATION
+    for (int i = 0; i < PP2D_SIN_STEPS + PP2D_SIN_STEPS/4 + 1; i++)
+    {
+        sinTable[i] = sinf(i*(2*M_PI/PP2D_SIN_STEPS));
+    }
+#endif
+
+    // chunks are indexed with 16 bit indices
+    vertices = vertices > 0x10000 ? 0x10000 : vertices;
+    vertices = vertices < PP2D_QUAD_VERTICES ? PP2D_QUAD_VERTICES : vertices;
+
+    memset(&vertexData, 0, sizeof(vertexData));
+    vertexData.capacity = vertices;
+    vertexData.stride = sizeof(vertex_s);
+    pp2d_buffer_grow(&vertexData);
+    pp2d_buffer_rewind(&vertexData, 0);
+
+    memset(&spriteData, 0, sizeof(spriteData));
+    spriteData.capacity = PP2D_MAX_GEOMETRY_SPRITES;
+    spriteData.stride = sizeof(sprite_vertex_s);
+
+    // enough indices for a full chunk of either buffer, allocated the first time recorded draws are replayed
+    memset(&indexData, 0, sizeof(indexData));
+    indexData.capacity = vertices/4*6 > PP2D_MAX_GEOMETRY_SPRITES ? vertices/4*6 : PP2D_MAX_GEOMETRY_SPRITES;
+    indexData.stride = sizeof(u16);
+    geometrySprites = false;
+
+    // corners of every instance in the order quads are written, with the number of their sprite
+    static const u8 corners[PP2D_QUAD_VERTICES][2] = {
+#if PP2D_INDEXED_QUADS
+        {0, 0}, {0, 1}, {1, 0}, {1, 1}
+#else
+        {0, 0}, {0, 1}, {1, 0}, {1, 0}, {0, 1}, {1, 1}
+#endif
+    };
+    instanceVbo = (u8*)linearAlloc(PP2D_INSTANCE_SPRITES*PP2D_QUAD_VERTICES*4);
+    for (size_t sprite = 0; sprite < PP2D_INSTANCE_SPRITES; sprite++)
+    {
+        for (size_t corner = 0; corner < PP2D_QUAD_VERTICES; corner++)
+        {
+            u8* vtx = &instanceVbo[(sprite*PP2D_QUAD_VERTICES + corner)*4];
+            vtx[0] = corners[corner][0];
+            vtx[1] = corners[corner][1];
+            vtx[2] = sprite;
+            vtx[3] = 0;
+        }
+    }
+    instanceCount = 0;
+    instancedSprites = false;
+
+    memset(&gpuState, 0, sizeof(gpuState));
+    gpuState.clip = PP2D_CLIP_NONE;
+    currentClip = PP2D_CLIP_NONE;
+    clipDepth = 0;
+    clipOverflow = 0;
+    memset(&stateStats, 0, sizeof(stateStats));
+    targetProjection = NULL;
+    targetWidth = 0;
+    cullBounds[0] = cullBounds[1] = -INFINITY;
+    cullBounds[2] = cullBounds[3] = INFINITY;
+    pp2d_bind_program(PP2D_PROGRAM_QUADS);
+
+#if PP2D_INDEXED_QUADS
+    // also used by instanced sprites, whatever the size of a chunk
+    const size_t quads = vertices/4 > PP2D_INSTANCE_SPRITES ? vertices/4 : PP2D_INSTANCE_SPRITES;
+    quadIndices = (u16*)linearAlloc(sizeof(u16)*quads*6);
+    for (size_t quad = 0; quad < quads; quad++)
+    {
+        u16* idx = &quadIndices[quad*6];
+        idx[0] = quad*4;
+        idx[1] = quad*4 + 1;
+        idx[2] = quad*4 + 2;
+        idx[3] = quad*4 + 2;
+        idx[4] = quad*4 + 1;
+        idx[5] = quad*4 + 3;
+    }
+#endif
 
-    prevColor = 0;
-    prevSpritesheet = PP2D_MAX_TEXTURES;
-    renderedText = false;
 }
 
 void pp2d_load_texture_memory(size_t id, void* buf, u32 width, u32 height, GX_TRANSFER_FORMAT fmt)
 {
+    if (gpuState.texture == &textures[id].tex)
+    {
+        pp2d_draw_unprocessed_queue();
+        gpuState.texture = NULL;
+    }
+
     GSPGPU_FlushDataCache(buf, width * height * 4);
     C3D_TexInit(&textures[id].tex, (u16)width, (u16)height, GPU_RGBA8);
     C3D_SafeDisplayTransfer((u32*)buf, GX_BUFFER_DIM(width, height), (u32*)textures[id].tex.data, GX_BUFFER_DIM(width, height), TEXTURE_TRANSFER_FLAGS(fmt));
@@ -554,184 +1892,1115 @@ void pp2d_load_texture_png_memory(size_t id, void* buf, size_t buf_size)
     linearFree(gpusrc);
 }
 
-void pp2d_set_3D(bool enable)
+void pp2d_mask_begin(void)
 {
-    gfxSet3D(enable);
+    pp2d_set_mask(PP2D_MASK_WRITE | pp2d_next_mask_ref());
 }
 
-static void pp2d_set_rendered_flags(bool texture, bool text, bool rectangle)
+void pp2d_mask_disable(void)
 {
-    renderedTexture = texture;
-    renderedText = text;
-    renderedRectangle = rectangle;
+    pp2d_set_mask(0);
 }
 
-void pp2d_set_screen_color(gfxScreen_t target, u32 color)
+void pp2d_mask_end(void)
 {
-    if (target == GFX_TOP)
-    {
-        C3D_RenderTargetSetClear(topLeft, C3D_CLEAR_ALL, color, 0);
-        C3D_RenderTargetSetClear(topRight, C3D_CLEAR_ALL, color, 0);
-    }
-    else
+    if (currentClip.mask & PP2D_MASK_WRITE)
     {
-        C3D_RenderTargetSetClear(bot, C3D_CLEAR_ALL, color, 0);
+        pp2d_set_mask(PP2D_MASK_TEST | (currentClip.mask & 0xFF));
     }
 }
 
-static void pp2d_set_text_color(u32 color)
+static void pp2d_merge_draws(void)
 {
-    C3D_TexEnv* env = C3D_GetTexEnv(0);
-    C3D_TexEnvSrc(env, C3D_RGB, GPU_CONSTANT, 0, 0);
-    C3D_TexEnvSrc(env, C3D_Alpha, GPU_TEXTURE0, GPU_CONSTANT, 0);
-    C3D_TexEnvOp(env, C3D_Both, 0, 0, 0);
-    C3D_TexEnvFunc(env, C3D_RGB, GPU_REPLACE);
-    C3D_TexEnvFunc(env, C3D_Alpha, GPU_MODULATE);
-    C3D_TexEnvColor(env, color);
+    // each run joins the latest batch with the same texture, env and program, unless a batch drawn in between overlaps it,
+    // so runs only move ahead of draws they don't touch and the painter's order of overlaps is kept.
+    // A different clip only keeps a run out of a batch when it would cut the run differently
+    size_t batchCount = 0;
+    for (size_t i = 0; i < drawList.count; i++)
+    {
+        pp2d_draw_item_t* item = &drawList.items[i];
+        const u32 state = (u32)item->key >> 13;
+        size_t target = batchCount;
+        for (size_t b = batchCount; b > 0 && batchCount - b < PP2D_MERGE_WINDOW; b--)
+        {
+            const pp2d_batch_t* batch = &drawList.batches[b - 1];
+            const pp2d_clip_t* clip = &drawList.items[batch->first].clip;
+            if (batch->state == state && pp2d_same_clip_within(clip, &item->clip, item->bounds))
+            {
+                item->clip = *clip;
+                target = b - 1;
+                break;
+            }
+            if (item->bounds[0] < batch->bounds[2] && batch->bounds[0] < item->bounds[2]
+                && item->bounds[1] < batch->bounds[3] && batch->bounds[1] < item->bounds[3])
+            {
+                break;
+            }
+        }
+
+        pp2d_batch_t* batch = &drawList.batches[target];
+        drawList.next[i] = UINT32_MAX;
+        if (target == batchCount)
+        {
+            batchCount++;
+            batch->state = state;
+            batch->first = i;
+            memcpy(batch->bounds, item->bounds, sizeof(batch->bounds));
+        }
+        else
+        {
+            drawList.next[batch->last] = i;
+            batch->bounds[0] = item->bounds[0] < batch->bounds[0] ? item->bounds[0] : batch->bounds[0];
+            batch->bounds[1] = item->bounds[1] < batch->bounds[1] ? item->bounds[1] : batch->bounds[1];
+            batch->bounds[2] = item->bounds[2] > batch->bounds[2] ? item->bounds[2] : batch->bounds[2];
+            batch->bounds[3] = item->bounds[3] > batch->bounds[3] ? item->bounds[3] : batch->bounds[3];
+        }
+        batch->last = i;
+    }
+
+    size_t order = 0;
+    for (size_t b = 0; b < batchCount; b++)
+    {
+        for (u32 i = drawList.batches[b].first; i != UINT32_MAX; i = drawList.next[i])
+        {
+            drawList.keys[order++].item = i;
+        }
+    }
 }
 
-void pp2d_set_texture_filter(GPU_TEXTURE_FILTER_PARAM magFilter, GPU_TEXTURE_FILTER_PARAM minFilter)
+static inline u8 pp2d_next_mask_ref(void)
 {
-    textureFilters.magFilter = magFilter;
-    textureFilters.minFilter = minFilter;
+    // past 255 masks in a frame, references of the first ones are given again
+    maskRef = maskRef == 0xFF ? 1 : maskRef + 1;
+    return maskRef;
 }
 
-void pp2d_texture_select_part(size_t id, int x, int y, int xbegin, int ybegin, int width, int height)
+static void pp2d_offset_projection(C3D_Mtx* out, const C3D_Mtx* projection, float x, float y)
 {
-    if (id >= PP2D_MAX_TEXTURES)
+    *out = *projection;
+    if (!opaquePass)
     {
-        pp2dBuffer.initialized = false;
+        Mtx_Translate(out, x, y, 0, true);
         return;
     }
-    
-    pp2dBuffer.id = id;
-    pp2dBuffer.x = x;
-    pp2dBuffer.y = y;
-    pp2dBuffer.xbegin = xbegin;
-    pp2dBuffer.ybegin = ybegin;
-    pp2dBuffer.width = width;
-    pp2dBuffer.height = height;
-    pp2dBuffer.color = PP2D_DEFAULT_COLOR_NEUTRAL;
-    pp2dBuffer.fliptype = PP2D_FLIP_NONE;
-    pp2dBuffer.scaleX = 1;
-    pp2dBuffer.scaleY = 1;
-    pp2dBuffer.angle = 0;
-    pp2dBuffer.depth = PP2D_DEFAULT_DEPTH;
-    pp2dBuffer.initialized = true;
-}
 
-void pp2d_texture_blend(u32 color)
-{
-    pp2dBuffer.color = color;
+    // vertices kept across frames hold the depth they were written at, while the opaque pass needs the depth of the current layer
+    Mtx_Translate(out, x, y, pp2d_record_depth(PP2D_DEFAULT_DEPTH), true);
+    Mtx_Scale(out, 1.0f, 1.0f, 0.0f);
 }
 
-void pp2d_texture_depth(float depth)
+static inline void pp2d_record_bounds(float left, float top, float right, float bottom)
 {
-    pp2dBuffer.depth = depth;
+    drawList.bounds[0] = left < drawList.bounds[0] ? left : drawList.bounds[0];
+    drawList.bounds[1] = top < drawList.bounds[1] ? top : drawList.bounds[1];
+    drawList.bounds[2] = right > drawList.bounds[2] ? right : drawList.bounds[2];
+    drawList.bounds[3] = bottom > drawList.bounds[3] ? bottom : drawList.bounds[3];
 }
 
-void pp2d_texture_flip(flipType_t fliptype)
+static inline float pp2d_record_depth(float depth)
 {
-    pp2dBuffer.fliptype = fliptype;
+    if (recordDraws && depth != drawList.depth)
+    {
+        pp2d_record_run();
+        drawList.depth = depth;
+    }
+
+    // during the opaque pass, the depth test keeps higher layers in front whatever the order they are drawn in.
+    // The depth buffer holds 1 - z and keeps the greater value, so higher layers get a smaller z
+    return opaquePass ? 1.0f - (drawList.layer + 1)*(1.0f/256) : depth;
 }
 
-void pp2d_texture_queue(void)
+static void pp2d_record_run(void)
 {
-    if (!pp2dBuffer.initialized || vertexData.cur + 6 > PP2D_MAX_VERTICES)
+    pp2d_buffer_t* buffer = drawList.program == PP2D_PROGRAM_SPRITES ? &spriteData : &vertexData;
+    if (buffer->cur == buffer->old)
     {
         return;
     }
-    
-    size_t id = pp2dBuffer.id;
-    
-    float left = (float)pp2dBuffer.xbegin / (float)textures[id].tex.width;
-    float right = (float)(pp2dBuffer.xbegin + pp2dBuffer.width) / (float)textures[id].tex.width;
-    float top = (float)(textures[id].tex.height - pp2dBuffer.ybegin) / (float)textures[id].tex.height;
-    float bottom = (float)(textures[id].tex.height - pp2dBuffer.ybegin - pp2dBuffer.height) / (float)textures[id].tex.height;
-    
-    // scaling
-    pp2dBuffer.height *= pp2dBuffer.scaleY;
-    pp2dBuffer.width *= pp2dBuffer.scaleX;
-    float vert[6][2] = {
-        {                   pp2dBuffer.x,                     pp2dBuffer.y},
-        {                   pp2dBuffer.x, pp2dBuffer.y + pp2dBuffer.height},
-        {pp2dBuffer.width + pp2dBuffer.x,                     pp2dBuffer.y},
-        {pp2dBuffer.width + pp2dBuffer.x,                     pp2dBuffer.y},
-        {                   pp2dBuffer.x, pp2dBuffer.y + pp2dBuffer.height},
-        {pp2dBuffer.width + pp2dBuffer.x, pp2dBuffer.y + pp2dBuffer.height},
-    };
 
-    // flipping
-    if (pp2dBuffer.fliptype == PP2D_FLIP_BOTH || pp2dBuffer.fliptype == PP2D_FLIP_HORI)
-    {
-        float tmp = left;
-        left = right;
-        right = tmp;
-    }
-    if (pp2dBuffer.fliptype == PP2D_FLIP_BOTH || pp2dBuffer.fliptype == PP2D_FLIP_VERT)
-    {
-        float tmp = top;
-        top = bottom;
-        bottom = tmp;
-    }
-    
-    // rotating
-    pp2dBuffer.angle = fmod(pp2dBuffer.angle, 360);
-    if (pp2dBuffer.angle != 0)
+    if (drawList.count == drawList.capacity)
     {
-        const float rad = pp2dBuffer.angle/(180/M_PI);
-        const float c = cosf(rad);
-        const float s = sinf(rad);
-        
-        const float xcenter = pp2dBuffer.x + pp2dBuffer.width/2.0f;
-        const float ycenter = pp2dBuffer.y + pp2dBuffer.height/2.0f;
-        
-        for (int i = 0; i < 6; i++)
+        const size_t capacity = drawList.capacity ? drawList.capacity*2 : 256;
+        pp2d_draw_item_t* items = realloc(drawList.items, sizeof(pp2d_draw_item_t)*capacity);
+        if (items != NULL)
         {
-            float oldx = vert[i][0];
-            float oldy = vert[i][1];
-            
-            vert[i][0] = c * (oldx - xcenter) - s * (oldy - ycenter) + xcenter;
-            vert[i][1] = s * (oldx - xcenter) + c * (oldy - ycenter) + ycenter;
+            drawList.items = items;
+        }
+        pp2d_sort_key_t* keys = realloc(drawList.keys, sizeof(pp2d_sort_key_t)*capacity);
+        if (keys != NULL)
+        {
+            drawList.keys = keys;
+        }
+        pp2d_sort_key_t* scratch = realloc(drawList.scratch, sizeof(pp2d_sort_key_t)*capacity);
+        if (scratch != NULL)
+        {
+            drawList.scratch = scratch;
         }
+        pp2d_batch_t* batches = realloc(drawList.batches, sizeof(pp2d_batch_t)*capacity);
+        if (batches != NULL)
+        {
+            drawList.batches = batches;
+        }
+        u32* next = realloc(drawList.next, sizeof(u32)*capacity);
+        if (next != NULL)
+        {
+            drawList.next = next;
+        }
+        if (items == NULL || keys == NULL || scratch == NULL || batches == NULL || next == NULL)
+        {
+            buffer->old = buffer->cur;
+            pp2d_record_reset_bounds();
+            return;
+        }
+        drawList.capacity = capacity;
     }
 
-    const bool changeSheet = id != prevSpritesheet;
-    const bool changeColor = pp2dBuffer.color != prevColor;
-    // draw the remaining vertices in the queue before changing data
-    if ((changeSheet || changeColor) && (vertexData.cur > 0))
+    // key, most significant first: opaque runs first, layer, depth from back to front, then rectangles, textures and text,
+    // so text stays over shapes at equal depth, then program, texture and clip to group state.
+    // The depth buffer holds 1 - z, so the back is the greatest depth.
+    // Opaque runs go from the front layer to the back one, so the depth test rejects what they hide
+    const bool opaque = opaquePass && drawList.opaque && drawList.env != PP2D_ENV_TEXT;
+    const u32 layer = opaque ? 0xFF - drawList.layer : 0x100 | drawList.layer;
+    const float depth = drawList.depth < 0 ? 0 : (drawList.depth > 1 ? 1 : drawList.depth);
+    const u32 envOrder = drawList.env == PP2D_ENV_TEXT ? 2 : (drawList.env == PP2D_ENV_TEXTURE ? 1 : 0);
+    const C3D_Tex* texture = drawList.env == PP2D_ENV_RECTANGLE ? NULL : drawList.texture;
+
+    pp2d_draw_item_t* item = &drawList.items[drawList.count];
+    item->key = (u64)layer << 55 | (u64)(u32)((1.0f - depth)*0x7FFFFF) << 32 | (u64)envOrder << 30
+        | (u64)drawList.program << 29 | (u64)(pp2d_texture_slot(texture) & 0xFFFF) << 13 | (drawList.clipId & 0x1FFF);
+    item->texture = texture;
+    item->first = buffer->old;
+    item->count = buffer->cur - buffer->old;
+    item->chunk = buffer->chunk;
+    item->program = drawList.program;
+    item->env = drawList.env;
+    item->clip = drawList.clip;
+    memcpy(item->bounds, drawList.bounds, sizeof(item->bounds));
+    if (item->bounds[0] > item->bounds[2])
     {
-        pp2d_draw_arrays();
+        // vertices written by hand have no known bounds, so they are assumed to cover everything
+        item->bounds[0] = item->bounds[1] = -INFINITY;
+        item->bounds[2] = item->bounds[3] = INFINITY;
     }
 
-    // binding
-    if (changeSheet || renderedText)
+    drawList.keys[drawList.count].key = item->key;
+    drawList.keys[drawList.count].item = drawList.count;
+    drawList.count++;
+    buffer->old = buffer->cur;
+    pp2d_record_reset_bounds();
+}
+
+static inline void pp2d_record_reset_bounds(void)
+{
+    drawList.bounds[0] = drawList.bounds[1] = INFINITY;
+    drawList.bounds[2] = drawList.bounds[3] = -INFINITY;
+}
+
+void pp2d_pop_clip(void)
+{
+    if (clipOverflow > 0)
+    {
+        clipOverflow--;
+        return;
+    }
+    if (clipDepth == 0)
+    {
+        return;
+    }
+
+    clipDepth--;
+    memcpy(cullBounds, clipStack[clipDepth].cullBounds, sizeof(cullBounds));
+    const u16 mask = currentClip.mask;
+    currentClip = clipStack[clipDepth].clip;
+    currentClip.mask = mask;
+}
+
+void pp2d_push_clip(int x, int y, int width, int height)
+{
+    if (clipDepth == PP2D_MAX_CLIP_RECTS)
+    {
+        clipOverflow++;
+        return;
+    }
+
+    // nested clip rects only keep what all of them let through. Every side is clamped to the current clip,
+    // which stays within 16 bits, before being narrowed into it
+    const long long left = x;
+    const long long top = y;
+    const long long right = left + width;
+    const long long bottom = top + height;
+    pp2d_clip_t clip = {
+        left < currentClip.left ? currentClip.left : (left > currentClip.right ? currentClip.right : left),
+        top < currentClip.top ? currentClip.top : (top > currentClip.bottom ? currentClip.bottom : top),
+        right > currentClip.right ? currentClip.right : (right < currentClip.left ? currentClip.left : right),
+        bottom > currentClip.bottom ? currentClip.bottom : (bottom < currentClip.top ? currentClip.top : bottom),
+        currentClip.mask
+    };
+    clip.right = clip.right < clip.left ? clip.left : clip.right;
+    clip.bottom = clip.bottom < clip.top ? clip.top : clip.bottom;
+
+    clipStack[clipDepth].clip = currentClip;
+    memcpy(clipStack[clipDepth].cullBounds, cullBounds, sizeof(cullBounds));
+    clipDepth++;
+    currentClip = clip;
+
+    // what the clip rect hides is culled too
+    cullBounds[0] = clip.left > cullBounds[0] ? clip.left : cullBounds[0];
+    cullBounds[1] = clip.top > cullBounds[1] ? clip.top : cullBounds[1];
+    cullBounds[2] = clip.right < cullBounds[2] ? clip.right : cullBounds[2];
+    cullBounds[3] = clip.bottom < cullBounds[3] ? clip.bottom : cullBounds[3];
+}
+
+static inline float pp2d_random(u32* seed)
+{
+    // xorshift, read as a signed fraction in [-1, 1]
+    u32 value = *seed;
+    value ^= value << 13;
+    value ^= value >> 17;
+    value ^= value << 5;
+    *seed = value;
+    return (s32)value * (1.0f/2147483648.0f);
+}
+
+void pp2d_reset_state_stats(void)
+{
+    memset(&stateStats, 0, sizeof(stateStats));
+}
+
+static inline bool pp2d_same_clip(const pp2d_clip_t* a, const pp2d_clip_t* b)
+{
+    return pp2d_same_rect(a, b) && a->mask == b->mask;
+}
+
+static inline bool pp2d_same_clip_within(const pp2d_clip_t* a, const pp2d_clip_t* b, const float* bounds)
+{
+    // bounds inside both rects are cut the same by either of them
+    if (pp2d_same_clip(a, b))
+    {
+        return true;
+    }
+    return a->mask == b->mask
+        && bounds[0] >= a->left && bounds[1] >= a->top && bounds[2] <= a->right && bounds[3] <= a->bottom
+        && bounds[0] >= b->left && bounds[1] >= b->top && bounds[2] <= b->right && bounds[3] <= b->bottom;
+}
+
+static inline bool pp2d_same_rect(const pp2d_clip_t* a, const pp2d_clip_t* b)
+{
+    return a->left == b->left && a->top == b->top && a->right == b->right && a->bottom == b->bottom;
+}
+
+void pp2d_set_3D(bool enable)
+{
+    gfxSet3D(enable);
+}
+
+void pp2d_set_batch_merging(bool enable)
+{
+    pp2d_set_record_mode(sortDraws, enable, opaquePass);
+}
+
+void pp2d_set_draw_layer(u8 layer)
+{
+    if (recordDraws && layer != drawList.layer)
+    {
+        pp2d_record_run();
+    }
+    drawList.layer = layer;
+}
+
+void pp2d_set_draw_opaque(bool opaque)
+{
+    if (recordDraws && opaque != drawList.opaque)
+    {
+        pp2d_record_run();
+    }
+    drawList.opaque = opaque;
+}
+
+void pp2d_set_draw_sorting(bool enable)
+{
+    pp2d_set_record_mode(enable, mergeDraws, opaquePass);
+}
+
+static void pp2d_set_clip(const pp2d_clip_t* clip)
+{
+    if (recordDraws)
+    {
+        if (!pp2d_same_clip(clip, &drawList.clip))
+        {
+            pp2d_record_run();
+            drawList.clip = *clip;
+            drawList.clipId++;
+        }
+        return;
+    }
+
+    if (discardDraws)
+    {
+        return;
+    }
+
+    const bool sameMask = clip->mask == gpuState.clip.mask;
+    const bool sameRect = pp2d_same_rect(clip, &gpuState.clip);
+    stateStats.stencilChangesSkipped += sameMask;
+    stateStats.scissorChangesSkipped += sameRect;
+    if (sameMask && sameRect)
+    {
+        return;
+    }
+
+    pp2d_draw_unprocessed_queue();
+    if (!sameMask)
+    {
+        stateStats.stencilChanges++;
+        pp2d_bind_mask(clip->mask);
+    }
+    if (!sameRect)
+    {
+        stateStats.scissorChanges++;
+        pp2d_bind_scissor(clip);
+    }
+}
+
+static void pp2d_set_env(pp2d_env_t mode)
+{
+    if (recordDraws)
+    {
+        if (mode != drawList.env)
+        {
+            pp2d_record_run();
+            drawList.env = mode;
+        }
+        return;
+    }
+
+    // an unchanged screen draws nothing, so the shadow keeps the state the GPU really has
+    if (discardDraws)
+    {
+        return;
+    }
+
+    if (mode == gpuState.env)
+    {
+        stateStats.texEnvChangesSkipped++;
+        return;
+    }
+
+    pp2d_draw_unprocessed_queue();
+    gpuState.env = mode;
+    stateStats.texEnvChanges++;
+
+    C3D_TexEnv* env = C3D_GetTexEnv(0);
+    if (mode == PP2D_ENV_RECTANGLE)
+    {
+        C3D_TexEnvSrc(env, C3D_Both, GPU_PRIMARY_COLOR, 0, 0);
+        C3D_TexEnvOp(env, C3D_Both, 0, 0, 0);
+        C3D_TexEnvFunc(env, C3D_Both, GPU_REPLACE);
+    }
+    else if (mode == PP2D_ENV_TEXT)
+    {
+        // glyph sheets only hold alpha, the color comes from the vertices
+        C3D_TexEnvSrc(env, C3D_RGB, GPU_PRIMARY_COLOR, 0, 0);
+        C3D_TexEnvSrc(env, C3D_Alpha, GPU_TEXTURE0, GPU_PRIMARY_COLOR, 0);
+        C3D_TexEnvOp(env, C3D_Both, 0, 0, 0);
+        C3D_TexEnvFunc(env, C3D_RGB, GPU_REPLACE);
+        C3D_TexEnvFunc(env, C3D_Alpha, GPU_MODULATE);
+    }
+    else
+    {
+        // blending: the color is modulated per vertex, so tinted sprites don't break the batch
+        C3D_TexEnvSrc(env, C3D_Both, GPU_TEXTURE0, GPU_PRIMARY_COLOR, 0);
+        C3D_TexEnvOp(env, C3D_Both, 0, 0, 0);
+        C3D_TexEnvFunc(env, C3D_Both, GPU_MODULATE);
+    }
+}
+
+void pp2d_set_geometry_sprites(bool enable)
+{
+    if (enable && spriteData.chunkCount == 0 && pp2d_buffer_grow(&spriteData))
+    {
+        pp2d_buffer_rewind(&spriteData, 0);
+    }
+    geometrySprites = enable && spriteData.chunkCount > 0;
+}
+
+void pp2d_set_instanced_sprites(bool enable)
+{
+    instancedSprites = enable;
+}
+
+static void pp2d_set_mask(u16 mask)
+{
+    // the stencil is written and tested in submission order, so deferred and recorded draws can't cross a mask change
+    if (layerRecording.layer == NULL)
+    {
+        pp2d_draw_text_deferred();
+        pp2d_draw_recorded();
+    }
+    currentClip.mask = mask;
+}
+
+void pp2d_set_opaque_pass(bool enable)
+{
+    pp2d_set_record_mode(sortDraws, mergeDraws, enable);
+}
+
+static void pp2d_set_record_mode(bool sort, bool merge, bool opaque)
+{
+    if (layerRecording.layer != NULL)
+    {
+        layerRecording.sortRequest = sort;
+        layerRecording.mergeRequest = merge;
+        layerRecording.opaqueRequest = opaque;
+        return;
+    }
+
+    const bool record = sort || merge || opaque;
+    if (record && !recordDraws)
+    {
+        pp2d_draw_unprocessed_queue();
+        drawList.texture = gpuState.texture;
+        drawList.env = gpuState.env;
+        drawList.program = currentProgram;
+        drawList.clip = gpuState.clip;
+        drawList.depth = PP2D_DEFAULT_DEPTH;
+        pp2d_record_reset_bounds();
+    }
+    else if (recordDraws && (sort != sortDraws || merge != mergeDraws || opaque != opaquePass))
+    {
+        // what was recorded so far is replayed the way it was meant to
+        pp2d_draw_recorded();
+    }
+
+    recordDraws = record;
+    sortDraws = sort;
+    mergeDraws = merge;
+    opaquePass = opaque;
+}
+
+static void pp2d_set_program(pp2d_program_t target)
+{
+    if (recordDraws)
+    {
+        if (target != drawList.program)
+        {
+            pp2d_record_run();
+            drawList.program = target;
+        }
+        return;
+    }
+
+    if (discardDraws)
+    {
+        return;
+    }
+
+    if (target == currentProgram)
+    {
+        stateStats.programBindsSkipped++;
+        return;
+    }
+
+    pp2d_draw_unprocessed_queue();
+    stateStats.programBinds++;
+    pp2d_bind_program(target);
+}
+
+static void pp2d_set_projection(void)
+{
+    if (targetProjection == NULL)
+    {
+        return;
+    }
+
+    // the top screen uses the same matrix for both eyes, so compare contents rather than pointers
+    const GPU_SHADER_TYPE stage = currentProgram == PP2D_PROGRAM_SPRITES ? GPU_GEOMETRY_SHADER : GPU_VERTEX_SHADER;
+    if (gpuState.projectionValid[stage] && memcmp(&gpuState.projection[stage], targetProjection, sizeof(C3D_Mtx)) == 0)
+    {
+        stateStats.projectionUploadsSkipped++;
+        return;
+    }
+
+    gpuState.projection[stage] = *targetProjection;
+    gpuState.projectionValid[stage] = true;
+    stateStats.projectionUploads++;
+    if (currentProgram == PP2D_PROGRAM_SPRITES)
+    {
+        C3D_FVUnifMtx4x4(GPU_GEOMETRY_SHADER, uLoc_spriteProjection, targetProjection);
+    }
+    else if (currentProgram == PP2D_PROGRAM_INSTANCES)
+    {
+        C3D_FVUnifMtx4x4(GPU_VERTEX_SHADER, uLoc_instanceProjection, targetProjection);
+    }
+    else
+    {
+        C3D_FVUnifMtx4x4(GPU_VERTEX_SHADER, uLoc_projection, targetProjection);
+    }
+}
+
+void pp2d_set_screen_color(gfxScreen_t target, u32 color)
+{
+    if (target == GFX_TOP)
+    {
+        C3D_RenderTargetSetClear(topLeft, C3D_CLEAR_ALL, color, 0);
+        C3D_RenderTargetSetClear(topRight, C3D_CLEAR_ALL, color, 0);
+    }
+    else
+    {
+        C3D_RenderTargetSetClear(bot, C3D_CLEAR_ALL, color, 0);
+    }
+}
+
+static void pp2d_set_screen_output(gfxScreen_t target, bool linked)
+{
+    if (target == GFX_TOP)
+    {
+        C3D_RenderTargetSetOutput(linked ? topLeft : NULL, GFX_TOP, GFX_LEFT, DISPLAY_TRANSFER_FLAGS);
+        C3D_RenderTargetSetOutput(linked ? topRight : NULL, GFX_TOP, GFX_RIGHT, DISPLAY_TRANSFER_FLAGS);
+    }
+    else
+    {
+        C3D_RenderTargetSetOutput(linked ? bot : NULL, GFX_BOTTOM, GFX_LEFT, DISPLAY_TRANSFER_FLAGS);
+    }
+}
+
+void pp2d_set_screen_unchanged(gfxScreen_t target, bool unchanged)
+{
+    if (unchanged == unchangedScreens[target])
+    {
+        return;
+    }
+
+    if (!unchanged && unchangedRedraws[target] == 0)
+    {
+        pp2d_set_screen_output(target, true);
+    }
+    unchangedScreens[target] = unchanged;
+    unchangedRedraws[target] = 1;
+}
+
+void pp2d_set_text_deferred(bool enable)
+{
+    if (layerRecording.layer != NULL)
+    {
+        layerRecording.deferredTextRequest = enable;
+        return;
+    }
+
+    if (!enable)
+    {
+        pp2d_draw_text_deferred();
+    }
+    deferredText = enable;
+}
+
+static void pp2d_set_texture(const C3D_Tex* texture)
+{
+    if (recordDraws)
+    {
+        if (texture != drawList.texture)
+        {
+            pp2d_record_run();
+            drawList.texture = texture;
+        }
+        return;
+    }
+
+    if (discardDraws)
+    {
+        return;
+    }
+
+    if (texture == gpuState.texture)
+    {
+        stateStats.textureBindsSkipped++;
+        return;
+    }
+
+    // draw the remaining vertices in the queue before changing data
+    pp2d_draw_unprocessed_queue();
+    gpuState.texture = texture;
+    stateStats.textureBinds++;
+    C3D_TexBind(0, (C3D_Tex*)texture);
+}
+
+void pp2d_set_texture_filter(GPU_TEXTURE_FILTER_PARAM magFilter, GPU_TEXTURE_FILTER_PARAM minFilter)
+{
+    textureFilters.magFilter = magFilter;
+    textureFilters.minFilter = minFilter;
+}
+
+static inline void pp2d_sincos(float angle, float* s, float* c)
+{
+#if PP2D_LUT_ROTATION
+    // a 16 bit fraction of a turn wraps around for free, its top 10 bits index the table and the rest interpolate
+    // angles the conversion can't hold are reduced first. NaN and infinities fail both comparisons and reduce to NaN,
+    // which is drawn unrotated rather than converted
+    if (!(angle <= PP2D_ANGLE_LIMIT && angle >= -PP2D_ANGLE_LIMIT))
+    {
+        angle = fmodf(angle, 360);
+        angle = isnan(angle) ? 0 : angle;
+    }
+    const u32 turn = (u32)(s32)(angle*(65536.0f/360)) & 0xFFFF;
+    const u32 index = turn >> 6;
+    const float frac = (turn & 63)*(1.0f/64);
+    *s = sinTable[index] + (sinTable[index + 1] - sinTable[index])*frac;
+    *c = sinTable[index + PP2D_SIN_STEPS/4] + (sinTable[index + PP2D_SIN_STEPS/4 + 1] - sinTable[index + PP2D_SIN_STEPS/4])*frac;
+#else
+    const float rad = fmod(angle, 360)/(180/M_PI);
+    *s = sinf(rad);
+    *c = cosf(rad);
+#endif
+}
+
+static void pp2d_sort_draws(void)
+{
+    // least significant digit first radix sort, 8 bits at a time, skipping digits every key shares
+    static u32 histograms[8][256];
+    const size_t count = drawList.count;
+    memset(histograms, 0, sizeof(histograms));
+    for (size_t i = 0; i < count; i++)
+    {
+        const u64 key = drawList.keys[i].key;
+        for (int digit = 0; digit < 8; digit++)
+        {
+            histograms[digit][(key >> (digit*8)) & 0xFF]++;
+        }
+    }
+
+    for (int digit = 0; digit < 8; digit++)
+    {
+        u32* histogram = histograms[digit];
+        if (histogram[(drawList.keys[0].key >> (digit*8)) & 0xFF] == count)
+        {
+            continue;
+        }
+
+        u32 offset = 0;
+        for (int bucket = 0; bucket < 256; bucket++)
+        {
+            const u32 size = histogram[bucket];
+            histogram[bucket] = offset;
+            offset += size;
+        }
+
+        for (size_t i = 0; i < count; i++)
+        {
+            const pp2d_sort_key_t key = drawList.keys[i];
+            drawList.scratch[histogram[(key.key >> (digit*8)) & 0xFF]++] = key;
+        }
+
+        pp2d_sort_key_t* tmp = drawList.keys;
+        drawList.keys = drawList.scratch;
+        drawList.scratch = tmp;
+    }
+}
+
+void pp2d_static_layer_begin(size_t id)
+{
+    if (id >= PP2D_MAX_STATIC_LAYERS || layerRecording.layer != NULL)
+    {
+        return;
+    }
+
+    // what is pending belongs to the frame, not to the layer
+    if (recordDraws)
+    {
+        pp2d_record_run();
+    }
+    else
+    {
+        pp2d_draw_unprocessed_queue();
+    }
+
+    pp2d_static_layer_t* layer = &staticLayers[id];
+    if (layer->vertexData.chunkCount == 0)
+    {
+        // chunks are drawn through the static quad indices, so they can't be bigger than the frame's ones
+        layer->vertexData.capacity = PP2D_STATIC_LAYER_VERTICES < vertexData.capacity ? PP2D_STATIC_LAYER_VERTICES : vertexData.capacity;
+        layer->vertexData.stride = sizeof(vertex_s);
+        layer->spriteData.capacity = layer->vertexData.capacity/PP2D_QUAD_VERTICES;
+        layer->spriteData.stride = sizeof(sprite_vertex_s);
+        if (!pp2d_buffer_grow(&layer->vertexData))
+        {
+            return;
+        }
+    }
+    if (geometrySprites && layer->spriteData.chunkCount == 0 && !pp2d_buffer_grow(&layer->spriteData))
+    {
+        return;
+    }
+
+    layerRecording.layer = layer;
+    layerRecording.drawList = drawList;
+    layerRecording.vertexData = vertexData;
+    layerRecording.spriteData = spriteData;
+    layerRecording.recordDraws = recordDraws;
+    layerRecording.sortDraws = sortDraws;
+    layerRecording.mergeDraws = mergeDraws;
+    layerRecording.opaquePass = opaquePass;
+    layerRecording.deferredText = deferredText;
+    memcpy(layerRecording.cullBounds, cullBounds, sizeof(cullBounds));
+    layerRecording.clip = currentClip;
+    layerRecording.sortRequest = sortDraws;
+    layerRecording.mergeRequest = mergeDraws;
+    layerRecording.opaqueRequest = opaquePass;
+    layerRecording.deferredTextRequest = deferredText;
+
+    // draws are recorded as runs into the layer's own list and buffers, in the order they come
+    drawList = layer->list;
+    drawList.count = 0;
+    drawList.texture = recordDraws ? layerRecording.drawList.texture : gpuState.texture;
+    drawList.env = recordDraws ? layerRecording.drawList.env : gpuState.env;
+    drawList.program = recordDraws ? layerRecording.drawList.program : currentProgram;
+    drawList.clip = recordDraws ? layerRecording.drawList.clip : gpuState.clip;
+    drawList.depth = PP2D_DEFAULT_DEPTH;
+    drawList.layer = 0;
+    drawList.opaque = false;
+    pp2d_record_reset_bounds();
+    // the clip and mask are the ones of wherever the layer is drawn, so it's recorded without them
+    currentClip = PP2D_CLIP_NONE;
+    vertexData = layer->vertexData;
+    spriteData = layer->spriteData;
+    // the layer may have been drawn earlier in this frame, so it's recorded into chunks the GPU is done with
+    pp2d_buffer_next(&vertexData);
+    if (spriteData.chunkCount > 0)
+    {
+        pp2d_buffer_next(&spriteData);
+    }
+    recordDraws = true;
+    sortDraws = false;
+    mergeDraws = false;
+    opaquePass = false;
+    deferredText = false;
+
+    // the layer may be drawn on any target, so nothing is culled
+    cullBounds[0] = cullBounds[1] = -INFINITY;
+    cullBounds[2] = cullBounds[3] = INFINITY;
+}
+
+void pp2d_static_layer_draw(size_t id)
+{
+    if (id >= PP2D_MAX_STATIC_LAYERS || layerRecording.layer != NULL || staticLayers[id].list.count == 0 || discardDraws)
+    {
+        return;
+    }
+
+    // the layer goes over everything submitted before it
+    pp2d_draw_recorded();
+    pp2d_draw_unprocessed_queue();
+
+    const bool record = recordDraws;
+    const pp2d_buffer_t frameVertices = vertexData;
+    const pp2d_buffer_t frameSprites = spriteData;
+    const pp2d_static_layer_t* layer = &staticLayers[id];
+    const C3D_Mtx* projection = targetProjection;
+    recordDraws = false;
+    vertexData = layer->vertexData;
+    spriteData = layer->spriteData;
+    vertexData.vbo = NULL;
+    spriteData.vbo = NULL;
+
+    // during the opaque pass the layer is drawn at the depth of the current layer, like the draws around it
+    C3D_Mtx layerProjection;
+    if (opaquePass && projection != NULL)
+    {
+        pp2d_offset_projection(&layerProjection, projection, 0, 0);
+        targetProjection = &layerProjection;
+        pp2d_set_projection();
+    }
+
+    // runs are clipped by the current clip rect too and tested against the current mask,
+    // while masks drawn by the layer get stencil references of this frame, so they never match older masks
+    u8 maskRefs[256] = { 0 };
+    for (size_t i = 0; i < layer->list.count; i++)
+    {
+        const pp2d_draw_item_t* item = &layer->list.items[i];
+        pp2d_set_program(item->program);
+        if (item->texture != NULL)
+        {
+            pp2d_set_texture(item->texture);
+        }
+        pp2d_set_env(item->env);
+        pp2d_clip_t clip = item->clip;
+        clip.left = clip.left > currentClip.left ? clip.left : currentClip.left;
+        clip.top = clip.top > currentClip.top ? clip.top : currentClip.top;
+        clip.right = clip.right < currentClip.right ? clip.right : currentClip.right;
+        clip.bottom = clip.bottom < currentClip.bottom ? clip.bottom : currentClip.bottom;
+        clip.right = clip.right < clip.left ? clip.left : clip.right;
+        clip.bottom = clip.bottom < clip.top ? clip.top : clip.bottom;
+        if (clip.mask != 0)
+        {
+            u8* ref = &maskRefs[clip.mask & 0xFF];
+            *ref = *ref != 0 ? *ref : pp2d_next_mask_ref();
+            clip.mask = (clip.mask & ~0xFF) | *ref;
+        }
+        else
+        {
+            clip.mask = currentClip.mask;
+        }
+        pp2d_set_clip(&clip);
+
+        pp2d_buffer_t* buffer = item->program == PP2D_PROGRAM_SPRITES ? &spriteData : &vertexData;
+        pp2d_buffer_rewind(buffer, item->chunk);
+        buffer->old = item->first;
+        buffer->cur = item->first + item->count;
+        pp2d_draw_unprocessed_queue();
+    }
+
+    targetProjection = projection;
+    pp2d_set_projection();
+    vertexData = frameVertices;
+    spriteData = frameSprites;
+    pp2d_bind_vbo();
+    recordDraws = record;
+}
+
+void pp2d_static_layer_end(void)
+{
+    pp2d_static_layer_t* layer = layerRecording.layer;
+    if (layer == NULL)
     {
-        prevSpritesheet = id;
-        C3D_TexBind(0, &textures[id].tex);
-        renderedText = false;
+        return;
     }
 
-    // blending
-    if (changeColor)
+    pp2d_record_run();
+    layer->list = drawList;
+    layer->vertexData = vertexData;
+    layer->spriteData = spriteData;
+    layer->clean = true;
+
+    drawList = layerRecording.drawList;
+    vertexData = layerRecording.vertexData;
+    spriteData = layerRecording.spriteData;
+    recordDraws = layerRecording.recordDraws;
+    sortDraws = layerRecording.sortDraws;
+    mergeDraws = layerRecording.mergeDraws;
+    opaquePass = layerRecording.opaquePass;
+    deferredText = layerRecording.deferredText;
+    memcpy(cullBounds, layerRecording.cullBounds, sizeof(cullBounds));
+    // clip rects and masks set while recording only apply inside the layer
+    currentClip = layerRecording.clip;
+    layerRecording.layer = NULL;
+
+    // recording may have switched program, so the frame's buffer is bound again
+    pp2d_bind_vbo();
+    pp2d_set_record_mode(layerRecording.sortRequest, layerRecording.mergeRequest, layerRecording.opaqueRequest);
+    pp2d_set_text_deferred(layerRecording.deferredTextRequest);
+}
+
+void pp2d_static_layer_free(size_t id)
+{
+    if (id >= PP2D_MAX_STATIC_LAYERS || &staticLayers[id] == layerRecording.layer)
     {
-        prevColor = pp2dBuffer.color;
-        C3D_TexEnv* env = C3D_GetTexEnv(0);
-        C3D_TexEnvSrc(env, C3D_Both, GPU_TEXTURE0, GPU_CONSTANT, 0);
-        C3D_TexEnvOp(env, C3D_Both, 0, 0, 0);
-        C3D_TexEnvFunc(env, C3D_Both, GPU_MODULATE);
-        C3D_TexEnvColor(env, pp2dBuffer.color);
+        return;
+    }
+
+    pp2d_static_layer_t* layer = &staticLayers[id];
+    pp2d_draw_list_free(&layer->list);
+    pp2d_buffer_free(&layer->vertexData);
+    pp2d_buffer_free(&layer->spriteData);
+    layer->clean = false;
+}
+
+bool pp2d_static_layer_is_dirty(size_t id)
+{
+    return id >= PP2D_MAX_STATIC_LAYERS || !staticLayers[id].clean;
+}
+
+void pp2d_static_layer_mark_dirty(size_t id)
+{
+    if (id < PP2D_MAX_STATIC_LAYERS)
+    {
+        staticLayers[id].clean = false;
+    }
+}
+
+void pp2d_texture_select_part(size_t id, int x, int y, int xbegin, int ybegin, int width, int height)
+{
+    if (id >= PP2D_MAX_TEXTURES)
+    {
+        pp2dBuffer.initialized = false;
+        return;
+    }
+    
+    pp2dBuffer.id = id;
+    pp2dBuffer.x = x;
+    pp2dBuffer.y = y;
+    pp2dBuffer.xbegin = xbegin;
+    pp2dBuffer.ybegin = ybegin;
+    pp2dBuffer.width = width;
+    pp2dBuffer.height = height;
+    pp2dBuffer.color = PP2D_DEFAULT_COLOR_NEUTRAL;
+    pp2dBuffer.fliptype = PP2D_FLIP_NONE;
+    pp2dBuffer.scaleX = 1;
+    pp2dBuffer.scaleY = 1;
+    pp2dBuffer.angle = 0;
+    pp2dBuffer.depth = PP2D_DEFAULT_DEPTH;
+    pp2dBuffer.initialized = true;
+}
+
+void pp2d_texture_blend(u32 color)
+{
+    pp2dBuffer.color = color;
+}
+
+void pp2d_texture_depth(float depth)
+{
+    pp2dBuffer.depth = depth;
+}
+
+void pp2d_texture_flip(flipType_t fliptype)
+{
+    pp2dBuffer.fliptype = fliptype;
+}
+
+void pp2d_texture_queue(void)
+{
+    if (!pp2dBuffer.initialized)
+    {
+        return;
+    }
+    
+    size_t id = pp2dBuffer.id;
+    
+    float left = (float)pp2dBuffer.xbegin / (float)textures[id].tex.width;
+    float right = (float)(pp2dBuffer.xbegin + pp2dBuffer.width) / (float)textures[id].tex.width;
+    float top = (float)(textures[id].tex.height - pp2dBuffer.ybegin) / (float)textures[id].tex.height;
+    float bottom = (float)(textures[id].tex.height - pp2dBuffer.ybegin - pp2dBuffer.height) / (float)textures[id].tex.height;
+    
+    // scaling
+    pp2dBuffer.height *= pp2dBuffer.scaleY;
+    pp2dBuffer.width *= pp2dBuffer.scaleX;
+
+    // flipping
+    if (pp2dBuffer.fliptype == PP2D_FLIP_BOTH || pp2dBuffer.fliptype == PP2D_FLIP_HORI)
+    {
+        float tmp = left;
+        left = right;
+        right = tmp;
+    }
+    if (pp2dBuffer.fliptype == PP2D_FLIP_BOTH || pp2dBuffer.fliptype == PP2D_FLIP_VERT)
+    {
+        float tmp = top;
+        top = bottom;
+        bottom = tmp;
+    }
+
+    if (pp2d_culled_sprite(pp2dBuffer.x, pp2dBuffer.y, pp2dBuffer.width, pp2dBuffer.height, pp2dBuffer.angle))
+    {
+        stateStats.spritesCulled++;
+        return;
+    }
+
+    pp2d_bind_texture(id);
+    pp2d_add_sprite(pp2dBuffer.x, pp2dBuffer.y, pp2dBuffer.width, pp2dBuffer.height, pp2dBuffer.angle, pp2dBuffer.depth, left, top, right, bottom, pp2dBuffer.color);
+}
+
+void pp2d_texture_queue_batch(size_t id, const pp2d_sprite_s* sprites, size_t count, size_t stride)
+{
+    if (id >= PP2D_MAX_TEXTURES || count == 0)
+    {
+        return;
+    }
+
+    const float invWidth = 1.0f / textures[id].tex.width;
+    const float invHeight = 1.0f / textures[id].tex.height;
+    const u8* record = (const u8*)sprites;
+    stride = stride == 0 ? sizeof(pp2d_sprite_s) : stride;
+
+    // the texture is bound for the first sprite in sight, so a batch culled whole leaves the pending draw and state alone
+    bool bound = false;
+    for (size_t i = 0; i < count; i++, record += stride)
+    {
+        const pp2d_sprite_s* sprite = (const pp2d_sprite_s*)record;
+        if (pp2d_culled_sprite(sprite->x, sprite->y, sprite->width, sprite->height, sprite->angle))
+        {
+            stateStats.spritesCulled++;
+            continue;
+        }
+        if (!bound)
+        {
+            pp2d_bind_texture(id);
+            bound = true;
+        }
+
+        const float left = sprite->xbegin * invWidth;
+        const float right = (sprite->xbegin + sprite->width) * invWidth;
+        const float top = 1.0f - sprite->ybegin * invHeight;
+        const float bottom = 1.0f - (sprite->ybegin + sprite->height) * invHeight;
+        pp2d_add_sprite(sprite->x, sprite->y, sprite->width, sprite->height, sprite->angle, PP2D_DEFAULT_DEPTH, left, top, right, bottom, sprite->color);
+    }
+}
+
+void pp2d_texture_queue_nine_slice(size_t id, const pp2d_nine_slice_s* slice, int x, int y, int width, int height, u32 color)
+{
+    if (id >= PP2D_MAX_TEXTURES || slice == NULL || width <= 0 || height <= 0)
+    {
+        return;
+    }
+
+    if (pp2d_culled(x, y, x + width, y + height))
+    {
+        stateStats.spritesCulled++;
+        return;
+    }
+
+    // borders keep their size, unless the panel is too small for both of them
+    float left = slice->left;
+    float right = slice->right;
+    float top = slice->top;
+    float bottom = slice->bottom;
+    if (left + right > width)
+    {
+        const float scale = width / (left + right);
+        left *= scale;
+        right *= scale;
+    }
+    if (top + bottom > height)
+    {
+        const float scale = height / (top + bottom);
+        top *= scale;
+        bottom *= scale;
     }
 
-    // rendering
-    pp2d_add_text_vertex(vert[0][0], vert[0][1], pp2dBuffer.depth, left, top);
-    pp2d_add_text_vertex(vert[1][0], vert[1][1], pp2dBuffer.depth, left, bottom);
-    pp2d_add_text_vertex(vert[2][0], vert[2][1], pp2dBuffer.depth, right, top);
-    pp2d_add_text_vertex(vert[3][0], vert[3][1], pp2dBuffer.depth, right, top);
-    pp2d_add_text_vertex(vert[4][0], vert[4][1], pp2dBuffer.depth, left, bottom);
-    pp2d_add_text_vertex(vert[5][0], vert[5][1], pp2dBuffer.depth, right, bottom);
+    // the edges of the slices, on the screen and in the texture
+    const float invWidth = 1.0f / textures[id].tex.width;
+    const float invHeight = 1.0f / textures[id].tex.height;
+    const float xs[4] = { x, x + left, x + width - right, x + width };
+    const float ys[4] = { y, y + top, y + height - bottom, y + height };
+    const float us[4] = {
+        slice->xbegin * invWidth,
+        (slice->xbegin + slice->left) * invWidth,
+        (slice->xbegin + slice->width - slice->right) * invWidth,
+        (slice->xbegin + slice->width) * invWidth,
+    };
+    const float vs[4] = {
+        1.0f - slice->ybegin * invHeight,
+        1.0f - (slice->ybegin + slice->top) * invHeight,
+        1.0f - (slice->ybegin + slice->height - slice->bottom) * invHeight,
+        1.0f - (slice->ybegin + slice->height) * invHeight,
+    };
 
-    pp2d_set_rendered_flags(true, false, false);
+    pp2d_bind_texture(id);
+    for (int row = 0; row < 3; row++)
+    {
+        for (int column = 0; column < 3; column++)
+        {
+            const float sliceWidth = xs[column + 1] - xs[column];
+            const float sliceHeight = ys[row + 1] - ys[row];
+            if (sliceWidth <= 0 || sliceHeight <= 0)
+            {
+                continue;
+            }
+            if (pp2d_culled(xs[column], ys[row], xs[column + 1], ys[row + 1]))
+            {
+                stateStats.spritesCulled++;
+                continue;
+            }
+            pp2d_add_sprite(xs[column], ys[row], sliceWidth, sliceHeight, 0, PP2D_DEFAULT_DEPTH, us[column], vs[row], us[column + 1], vs[row + 1], color);
+        }
+    }
 }
 
 void pp2d_texture_position(int x, int y)
@@ -749,4 +3018,288 @@ void pp2d_texture_scale(float scaleX, float scaleY)
 {
     pp2dBuffer.scaleX = scaleX;
     pp2dBuffer.scaleY = scaleY;
-}
\ No newline at end of file
+}
+
+static u32 pp2d_texture_slot(const C3D_Tex* texture)
+{
+    if (texture == NULL)
+    {
+        return 0;
+    }
+
+    const uintptr_t address = (uintptr_t)texture;
+    const uintptr_t sheets = (uintptr_t)glyphSheets;
+    if (address >= sheets && address < sheets + sizeof(C3D_Tex)*fontGetGlyphInfo()->nSheets)
+    {
+        return 1 + PP2D_MAX_TEXTURES + (address - sheets)/sizeof(C3D_Tex);
+    }
+    return 1 + (address - (uintptr_t)textures)/sizeof(textures[0]);
+}
+
+static bool pp2d_tilemap_build(pp2d_tilemap_t* map, int chunkColumn, int chunkRow)
+{
+    pp2d_buffer_t* chunk = &map->chunks[chunkRow*map->chunkColumns + chunkColumn];
+    map->dirty[chunkRow*map->chunkColumns + chunkColumn] = false;
+    chunk->cur = 0;
+
+    const int firstColumn = chunkColumn*map->chunkTileColumns;
+    const int firstRow = chunkRow*map->chunkTileRows;
+    const int lastColumn = firstColumn + map->chunkTileColumns < map->columns ? firstColumn + map->chunkTileColumns : map->columns;
+    const int lastRow = firstRow + map->chunkTileRows < map->rows ? firstRow + map->chunkTileRows : map->rows;
+
+    // chunks without tiles get no memory
+    bool empty = true;
+    for (int row = firstRow; row < lastRow && empty; row++)
+    {
+        for (int column = firstColumn; column < lastColumn && empty; column++)
+        {
+            empty = map->tiles[row*map->columns + column] == 0;
+        }
+    }
+    // draws made earlier in this frame may still read the chunk's vertices, so they're written in another chunk then
+    if (empty || !pp2d_buffer_next(chunk))
+    {
+        return false;
+    }
+
+    // tiles are numbered from 1, left to right then top to bottom across the texture
+    const size_t id = map->texture;
+    const int sheetColumns = (int)textures[id].width / map->tileWidth > 0 ? (int)textures[id].width / map->tileWidth : 1;
+    const float tileU = (float)map->tileWidth / textures[id].tex.width;
+    const float tileV = (float)map->tileHeight / textures[id].tex.height;
+
+    const pp2d_buffer_t frameVertices = vertexData;
+    vertexData.vbo = chunk->vbo;
+    vertexData.cur = 0;
+    for (int row = firstRow; row < lastRow; row++)
+    {
+        for (int column = firstColumn; column < lastColumn; column++)
+        {
+            const u16 tile = map->tiles[row*map->columns + column];
+            if (tile == 0)
+            {
+                continue;
+            }
+
+            const float left = (float)((column - firstColumn)*map->tileWidth);
+            const float top = (float)((row - firstRow)*map->tileHeight);
+            const float right = left + map->tileWidth;
+            const float bottom = top + map->tileHeight;
+            const float u = ((tile - 1) % sheetColumns)*tileU;
+            const float v = 1.0f - ((tile - 1) / sheetColumns)*tileV;
+
+            pp2d_add_text_vertex(left, top, PP2D_DEFAULT_DEPTH, u, v, PP2D_DEFAULT_COLOR_NEUTRAL);
+            pp2d_add_text_vertex(left, bottom, PP2D_DEFAULT_DEPTH, u, v - tileV, PP2D_DEFAULT_COLOR_NEUTRAL);
+            pp2d_add_text_vertex(right, top, PP2D_DEFAULT_DEPTH, u + tileU, v, PP2D_DEFAULT_COLOR_NEUTRAL);
+#if !PP2D_INDEXED_QUADS
+            pp2d_add_text_vertex(right, top, PP2D_DEFAULT_DEPTH, u + tileU, v, PP2D_DEFAULT_COLOR_NEUTRAL);
+            pp2d_add_text_vertex(left, bottom, PP2D_DEFAULT_DEPTH, u, v - tileV, PP2D_DEFAULT_COLOR_NEUTRAL);
+#endif
+            pp2d_add_text_vertex(right, bottom, PP2D_DEFAULT_DEPTH, u + tileU, v - tileV, PP2D_DEFAULT_COLOR_NEUTRAL);
+        }
+    }
+    chunk->cur = vertexData.cur;
+    vertexData = frameVertices;
+    return true;
+}
+
+void pp2d_tilemap_create(size_t id, size_t texture, int columns, int rows, int tileWidth, int tileHeight)
+{
+    if (id >= PP2D_MAX_TILEMAPS || texture >= PP2D_MAX_TEXTURES || columns <= 0 || rows <= 0 || tileWidth <= 0 || tileHeight <= 0)
+    {
+        return;
+    }
+
+    int chunkTileColumns = PP2D_TILEMAP_CHUNK;
+    int chunkTileRows = PP2D_TILEMAP_CHUNK;
+#if PP2D_COMPACT_VERTICES
+    // chunk-local positions go up to the chunk's far side, which compact vertices only reach within their range
+    if (chunkTileColumns*tileWidth > PP2D_COMPACT_POSITION_RANGE)
+    {
+        chunkTileColumns = PP2D_COMPACT_POSITION_RANGE / tileWidth;
+    }
+    if (chunkTileRows*tileHeight > PP2D_COMPACT_POSITION_RANGE)
+    {
+        chunkTileRows = PP2D_COMPACT_POSITION_RANGE / tileHeight;
+    }
+    if (chunkTileColumns == 0 || chunkTileRows == 0)
+    {
+        return;
+    }
+#endif
+
+    // chunks are drawn through the static quad indices, so they can't be bigger than the frame's buffer
+    const size_t capacity = chunkTileColumns*chunkTileRows*PP2D_QUAD_VERTICES;
+    if (capacity > vertexData.capacity)
+    {
+        return;
+    }
+
+    pp2d_tilemap_free(id);
+    pp2d_tilemap_t* map = &tilemaps[id];
+    map->chunkTileColumns = chunkTileColumns;
+    map->chunkTileRows = chunkTileRows;
+    map->chunkColumns = (columns + chunkTileColumns - 1) / chunkTileColumns;
+    map->chunkRows = (rows + chunkTileRows - 1) / chunkTileRows;
+    map->tiles = calloc(columns*rows, sizeof(u16));
+    map->chunks = calloc(map->chunkColumns*map->chunkRows, sizeof(pp2d_buffer_t));
+    map->dirty = calloc(map->chunkColumns*map->chunkRows, sizeof(bool));
+    if (map->tiles == NULL || map->chunks == NULL || map->dirty == NULL)
+    {
+        pp2d_tilemap_free(id);
+        return;
+    }
+
+    for (int chunk = 0; chunk < map->chunkColumns*map->chunkRows; chunk++)
+    {
+        map->chunks[chunk].capacity = capacity;
+        map->chunks[chunk].stride = sizeof(vertex_s);
+    }
+    map->texture = texture;
+    map->columns = columns;
+    map->rows = rows;
+    map->tileWidth = tileWidth;
+    map->tileHeight = tileHeight;
+}
+
+void pp2d_tilemap_draw(size_t id, int cameraX, int cameraY)
+{
+    if (id >= PP2D_MAX_TILEMAPS || tilemaps[id].tiles == NULL || layerRecording.layer != NULL || discardDraws)
+    {
+        return;
+    }
+
+    // the map goes over everything submitted before it
+    pp2d_draw_recorded();
+    pp2d_draw_unprocessed_queue();
+
+    pp2d_tilemap_t* map = &tilemaps[id];
+    const int chunkWidth = map->chunkTileColumns*map->tileWidth;
+    const int chunkHeight = map->chunkTileRows*map->tileHeight;
+    const int firstColumn = (int)floorf((cullBounds[0] + cameraX) / chunkWidth);
+    const int firstRow = (int)floorf((cullBounds[1] + cameraY) / chunkHeight);
+    const int lastColumn = (int)ceilf((cullBounds[2] + cameraX) / chunkWidth);
+    const int lastRow = (int)ceilf((cullBounds[3] + cameraY) / chunkHeight);
+
+    const bool record = recordDraws;
+    const pp2d_buffer_t frameVertices = vertexData;
+    const C3D_Mtx* projection = targetProjection;
+    recordDraws = false;
+    pp2d_set_program(PP2D_PROGRAM_QUADS);
+    pp2d_set_texture(&textures[map->texture].tex);
+    pp2d_set_env(PP2D_ENV_TEXTURE);
+    pp2d_set_clip(&currentClip);
+
+    // each chunk in sight is one draw call, moved in place by the projection instead of writing its vertices again
+    for (int chunkRow = firstRow < 0 ? 0 : firstRow; chunkRow < lastRow && chunkRow < map->chunkRows; chunkRow++)
+    {
+        for (int chunkColumn = firstColumn < 0 ? 0 : firstColumn; chunkColumn < lastColumn && chunkColumn < map->chunkColumns; chunkColumn++)
+        {
+            pp2d_buffer_t* chunk = &map->chunks[chunkRow*map->chunkColumns + chunkColumn];
+            if (map->dirty[chunkRow*map->chunkColumns + chunkColumn] && !pp2d_tilemap_build(map, chunkColumn, chunkRow))
+            {
+                continue;
+            }
+            if (chunk->cur == 0)
+            {
+                continue;
+            }
+
+            C3D_Mtx camera;
+            pp2d_offset_projection(&camera, projection, chunkColumn*chunkWidth - cameraX, chunkRow*chunkHeight - cameraY);
+            targetProjection = &camera;
+            pp2d_set_projection();
+
+            vertexData = *chunk;
+            vertexData.vbo = NULL;
+            pp2d_buffer_rewind(&vertexData, chunk->chunk);
+            vertexData.cur = chunk->cur;
+            pp2d_draw_unprocessed_queue();
+        }
+    }
+
+    targetProjection = projection;
+    pp2d_set_projection();
+    vertexData = frameVertices;
+    pp2d_bind_vbo();
+    recordDraws = record;
+}
+
+void pp2d_tilemap_free(size_t id)
+{
+    if (id >= PP2D_MAX_TILEMAPS)
+    {
+        return;
+    }
+
+    pp2d_tilemap_t* map = &tilemaps[id];
+    for (int chunk = 0; map->chunks != NULL && chunk < map->chunkColumns*map->chunkRows; chunk++)
+    {
+        pp2d_buffer_free(&map->chunks[chunk]);
+    }
+    free(map->tiles);
+    free(map->chunks);
+    free(map->dirty);
+    memset(map, 0, sizeof(*map));
+}
+
+u16 pp2d_tilemap_get_tile(size_t id, int column, int row)
+{
+    if (id >= PP2D_MAX_TILEMAPS || column < 0 || row < 0 || column >= tilemaps[id].columns || row >= tilemaps[id].rows)
+    {
+        return 0;
+    }
+    return tilemaps[id].tiles[row*tilemaps[id].columns + column];
+}
+
+void pp2d_tilemap_set_tile(size_t id, int column, int row, u16 tile)
+{
+    if (id >= PP2D_MAX_TILEMAPS || column < 0 || row < 0 || column >= tilemaps[id].columns || row >= tilemaps[id].rows)
+    {
+        return;
+    }
+
+    pp2d_tilemap_t* map = &tilemaps[id];
+    u16* current = &map->tiles[row*map->columns + column];
+    if (*current != tile)
+    {
+        *current = tile;
+        map->dirty[row/map->chunkTileRows*map->chunkColumns + column/map->chunkTileColumns] = true;
+    }
+}
+
+void pp2d_tilemap_set_tiles(size_t id, const u16* tiles)
+{
+    if (id >= PP2D_MAX_TILEMAPS || tilemaps[id].tiles == NULL || tiles == NULL)
+    {
+        return;
+    }
+
+    const pp2d_tilemap_t* map = &tilemaps[id];
+    for (int row = 0; row < map->rows; row++)
+    {
+        for (int column = 0; column < map->columns; column++)
+        {
+            pp2d_tilemap_set_tile(id, column, row, tiles[row*map->columns + column]);
+        }
+    }
+}
+
+static inline void pp2d_write_vertex(vertex_s* vtx, float vx, float vy, float vz, float tx, float ty, u32 color)
+{
+#if PP2D_COMPACT_VERTICES
+    vtx->x = pp2d_compact(vx, PP2D_COMPACT_POSITION_ONE);
+    vtx->y = pp2d_compact(vy, PP2D_COMPACT_POSITION_ONE);
+    vtx->z = pp2d_compact(vz, PP2D_COMPACT_UNIT_ONE);
+    vtx->w = 1;
+    vtx->u = pp2d_compact(tx, PP2D_COMPACT_UNIT_ONE);
+    vtx->v = pp2d_compact(ty, PP2D_COMPACT_UNIT_ONE);
+#else
+    vtx->x = vx;
+    vtx->y = vy;
+    vtx->z = vz;
+    vtx->u = tx;
+    vtx->v = ty;
+#endif
+    vtx->color = color;
+}
@@ -42,6 +42,8 @@ extern "C" {
 #include <stdlib.h>
 #include <string.h>
 #include "vshader_shbin.h"
+#include "sprite_shbin.h"
+#include "instance_shbin.h"
 
 /// Used to transfer the final rendered display to the framebuffer
 #define DISPLAY_TRANSFER_FLAGS \
@@ -95,12 +97,164 @@ extern "C" {
 #define PP2D_DEFAULT_COLOR_BG ABGR8(255, 0, 0, 0)
 #define PP2D_DEFAULT_COLOR_NEUTRAL RGBA8(255, 255, 255, 255)
 #define PP2D_DEFAULT_DEPTH 0.5f
+
+/// Vertices per chunk of the vertex buffer used by pp2d_init, frames needing more continue into extra chunks
+#ifndef PP2D_MAX_VERTICES
 #define PP2D_MAX_VERTICES 12288
+#endif
 
 #ifndef PP2D_MAX_TEXTURES 
 #define PP2D_MAX_TEXTURES 1
 #endif
 
+/// Quads are drawn from 4 vertices and a static index buffer, rather than 6 vertices. This changes how pp2d_draw_arrays reads the vertex buffer, see there
+#ifndef PP2D_INDEXED_QUADS
+#define PP2D_INDEXED_QUADS 1
+#endif
+
+#if PP2D_INDEXED_QUADS
+#define PP2D_QUAD_VERTICES 4
+#else
+#define PP2D_QUAD_VERTICES 6
+#endif
+
+#if PP2D_MAX_VERTICES > 0x10000
+#error "PP2D_MAX_VERTICES must fit 16 bit indices"
+#endif
+
+/// Vertices are stored as 16 bit integers rather than floats, positions then have to stay within PP2D_COMPACT_POSITION_RANGE pixels of the origin
+#ifndef PP2D_COMPACT_VERTICES
+#define PP2D_COMPACT_VERTICES 0
+#endif
+
+/// Pixels from the origin a compact vertex position can reach in 1/16th of pixel, further positions are clamped to it
+#define PP2D_COMPACT_POSITION_RANGE 2047
+
+/// Rotated sprites read sines and cosines from a lookup table rather than calling sinf and cosf
+#ifndef PP2D_LUT_ROTATION
+#define PP2D_LUT_ROTATION 1
+#endif
+
+/// Glyphs kept by deferred text until they are drawn, further glyphs flush the ones kept so far
+#ifndef PP2D_MAX_DEFERRED_GLYPHS
+#define PP2D_MAX_DEFERRED_GLYPHS 2048
+#endif
+
+#if PP2D_MAX_DEFERRED_GLYPHS > 0x10000
+#error "PP2D_MAX_DEFERRED_GLYPHS must fit the 16 bit order of deferred glyphs"
+#endif
+
+/// Sprites per chunk of the point buffer used while geometry shader sprites are enabled
+#ifndef PP2D_MAX_GEOMETRY_SPRITES
+#define PP2D_MAX_GEOMETRY_SPRITES 4096
+#endif
+
+#if PP2D_MAX_GEOMETRY_SPRITES > 0x10000
+#error "PP2D_MAX_GEOMETRY_SPRITES must fit 16 bit indices"
+#endif
+
+/// Static layers that can be recorded once and drawn every frame
+#ifndef PP2D_MAX_STATIC_LAYERS
+#define PP2D_MAX_STATIC_LAYERS 4
+#endif
+
+/// Vertices per chunk of a static layer, layers needing more continue into extra chunks
+#ifndef PP2D_STATIC_LAYER_VERTICES
+#define PP2D_STATIC_LAYER_VERTICES 2048
+#endif
+
+/// Tile maps that can be created at once
+#ifndef PP2D_MAX_TILEMAPS
+#define PP2D_MAX_TILEMAPS 2
+#endif
+
+/// Tiles on each side of a tile map chunk, the part of the map written again when one of its tiles changes and drawn with one call
+#ifndef PP2D_TILEMAP_CHUNK
+#define PP2D_TILEMAP_CHUNK 16
+#endif
+
+/// Particle emitters that can be created at once
+#ifndef PP2D_MAX_EMITTERS
+#define PP2D_MAX_EMITTERS 4
+#endif
+
+/// Clip rects that can be pushed at once, further pushes are ignored until they are popped
+#ifndef PP2D_MAX_CLIP_RECTS
+#define PP2D_MAX_CLIP_RECTS 16
+#endif
+
+/// Batches of different state a draw can move ahead of while batch merging is enabled
+#ifndef PP2D_MERGE_WINDOW
+#define PP2D_MERGE_WINDOW 32
+#endif
+
+/// GPU state changes emitted by pp2d, the redundant ones skipped because the state was already set,
+/// and the primitives dropped before writing vertices because they were outside the target or the clip rect
+typedef struct {
+    u32 glyphsCulled;
+    u32 programBinds;
+    u32 programBindsSkipped;
+    u32 projectionUploads;
+    u32 projectionUploadsSkipped;
+    u32 rectanglesCulled;
+    u32 scissorChanges;
+    u32 scissorChangesSkipped;
+    u32 spritesCulled;
+    u32 stencilChanges;
+    u32 stencilChangesSkipped;
+    u32 texEnvChanges;
+    u32 texEnvChangesSkipped;
+    u32 textureBinds;
+    u32 textureBindsSkipped;
+} pp2d_state_stats_s;
+
+/// A sprite read by pp2d_texture_queue_batch, which can be embedded in a bigger caller owned record
+typedef struct {
+    float x;
+    float y;
+    float angle;
+    u32 color;
+    u16 xbegin;
+    u16 ybegin;
+    u16 width;
+    u16 height;
+} pp2d_sprite_s;
+
+/// Where pp2d_texture_queue_nine_slice reads a panel in its texture, and the borders of it kept unscaled on each side
+typedef struct {
+    u16 xbegin;
+    u16 ybegin;
+    u16 width;
+    u16 height;
+    u16 left;
+    u16 top;
+    u16 right;
+    u16 bottom;
+} pp2d_nine_slice_s;
+
+/// How the particles of an emitter are spawned, moved and faded. Spreads are half ranges, picked at random for each particle
+typedef struct {
+    float x;
+    float y;
+    float spreadX;
+    float spreadY;
+    float velocityX;
+    float velocityY;
+    float velocitySpread;
+    float accelerationX;
+    float accelerationY;
+    float lifetime;
+    float lifetimeSpread;
+    float startSize;
+    float endSize;
+    u32 startColor;
+    u32 endColor;
+    u16 xbegin;
+    u16 ybegin;
+    u16 width;
+    u16 height;
+} pp2d_emitter_s;
+
 typedef enum {
     PP2D_FLIP_NONE,
     PP2D_FLIP_HORI,
@@ -108,12 +262,27 @@ typedef enum {
     PP2D_FLIP_BOTH
 } flipType_t;
 
+#if PP2D_COMPACT_VERTICES
+/// Positions in 1/16th of pixel up to PP2D_COMPACT_POSITION_RANGE, w always 1, depth and texture coordinates normalized to 32767
+typedef struct {
+    s16 x, y, z, w;
+    s16 u, v;
+    u32 color;
+} vertex_s;
+#else
 typedef struct { 
     float x, y, z; 
     float u, v;
+    u32 color;
 } vertex_s;
+#endif
 
-/// Draws queued verticies 
+/**
+ * @brief Draws queued verticies
+ * @note With PP2D_INDEXED_QUADS, the default, the vertices written since the last draw are read as quads of 4 (top left, bottom left, top right, bottom right)
+ * through the static index buffer, so their count must be a multiple of 4 and a partial quad is dropped. Before indexed quads they were read as triangles of 3 vertices
+ * with C3D_DrawArrays: build with PP2D_INDEXED_QUADS=0 to keep that behaviour for vertices written by hand
+ */
 void pp2d_draw_arrays(void);
 
 /**
@@ -148,6 +317,12 @@ void pp2d_draw_text(float x, float y, float scaleX, float scaleY, u32 color, con
  */
 void pp2d_draw_text_center(gfxScreen_t target, float y, float scaleX, float scaleY, u32 color, const char* text);
 
+/**
+ * @brief Draws the glyphs collected in deferred text mode, grouped by glyph sheet
+ * @note This is called automatically by pp2d_frame_draw_on and pp2d_frame_end
+ */
+void pp2d_draw_text_deferred(void);
+
 /**
  * @brief Prints a char pointer in the middle of the target screen
  * @param x position to start drawing
@@ -172,6 +347,56 @@ void pp2d_draw_text_wrap(float x, float y, float scaleX, float scaleY, u32 color
  */
 void pp2d_draw_textf(float x, float y, float scaleX, float scaleY, u32 color, const char* text, ...); 
 
+/**
+ * @brief Creates a particle emitter, or resets an existing one
+ * @param id of the emitter
+ * @param texture id of the texture particles are cut from
+ * @param capacity particles alive at once, further emissions are dropped
+ * @param settings spawn area, motion, lifetime, fade and texture rectangle of the particles, in pixels and seconds
+ */
+void pp2d_emitter_create(size_t id, size_t texture, size_t capacity, const pp2d_emitter_s* settings);
+
+/**
+ * @brief Queues the living particles of an emitter as squares centered on them
+ * @param id of the emitter
+ * @note Like pp2d_texture_queue_batch, particles are drawn at PP2D_DEFAULT_DEPTH without changing the pp2d_texture_select state
+ */
+void pp2d_emitter_draw(size_t id);
+
+/**
+ * @brief Spawns particles
+ * @param id of the emitter
+ * @param count particles to spawn
+ */
+void pp2d_emitter_emit(size_t id, size_t count);
+
+/**
+ * @brief Frees the memory held by a particle emitter
+ * @param id of the emitter
+ */
+void pp2d_emitter_free(size_t id);
+
+/**
+ * @brief Returns the particles alive in an emitter
+ * @param id of the emitter
+ */
+size_t pp2d_emitter_get_count(size_t id);
+
+/**
+ * @brief Changes the settings of an emitter
+ * @param id of the emitter
+ * @param settings as in pp2d_emitter_create
+ * @note Spawn area, velocity and lifetime apply to the particles emitted afterwards, everything else to the living ones too
+ */
+void pp2d_emitter_set(size_t id, const pp2d_emitter_s* settings);
+
+/**
+ * @brief Moves the particles of an emitter, ages them and removes the ones past their lifetime
+ * @param id of the emitter
+ * @param seconds elapsed since the last update
+ */
+void pp2d_emitter_update(size_t id, float seconds);
+
 /// Frees the pp2d environment
 void pp2d_exit(void);
 
@@ -198,6 +423,12 @@ void pp2d_frame_end(void);
  */
 void pp2d_free_texture(size_t id);
 
+/**
+ * @brief Copies the GPU state and culling counters accumulated since pp2d_init or pp2d_reset_state_stats
+ * @param stats pointer to the counters to fill
+ */
+void pp2d_get_state_stats(pp2d_state_stats_s* stats);
+
 /**
  * @brief Calculates a char pointer height
  * @param text char pointer to calculate the height of
@@ -242,6 +473,13 @@ float pp2d_get_text_width(const char* text, float scaleX, float scaleY);
  */
 void pp2d_init(void);
 
+/**
+ * @brief Inits the pp2d environment with a custom vertex buffer size
+ * @param vertices number of vertices per chunk of linear memory, capped to 65536 as draws reach them through 16 bit indices
+ * @note Frames needing more vertices are flushed and continue into extra chunks, which are kept until pp2d_exit
+ */
+void pp2d_init_with_capacity(size_t vertices);
+
 /**
  * @brief Loads a texture from a a buffer in memory
  * @param id of the texture 
@@ -267,12 +505,94 @@ void pp2d_load_texture_png(size_t id, const char* path);
  */
 void pp2d_load_texture_png_memory(size_t id, void* buf, size_t buf_size);
 
+/**
+ * @brief Starts a stencil mask: the next draws only mark the pixels they cover in the stencil buffer, leaving the picture untouched
+ * @note Transparent pixels of textures and text aren't marked, so sprites and rounded panels make masks of their own shape
+ */
+void pp2d_mask_begin(void);
+
+/// Lets the next draws show everywhere again, after pp2d_mask_begin or pp2d_mask_end
+void pp2d_mask_disable(void);
+
+/**
+ * @brief Ends the stencil mask started by pp2d_mask_begin, the next draws only show where the mask was drawn
+ * @note The mask is kept until pp2d_mask_disable, a new mask or a target change, and works along clip rects. Each mask gets its own stencil reference for the frame, up to 255
+ */
+void pp2d_mask_end(void);
+
+/// Gives back the clip rect in place before the last pp2d_push_clip
+void pp2d_pop_clip(void);
+
+/**
+ * @brief Clips the next draws on the current target to a rectangle, through the GPU scissor test
+ * @param x of the top left corner
+ * @param y of the top left corner
+ * @param width of the rectangle
+ * @param height of the rectangle
+ * @note The rectangle is intersected with the clip rect already pushed, and primitives it hides entirely are culled. Clip rects are cleared when the target changes.
+ * Any size is accepted, the rectangle is clamped before being kept in 16 bits
+ */
+void pp2d_push_clip(int x, int y, int width, int height);
+
+/// Clears the counters returned by pp2d_get_state_stats
+void pp2d_reset_state_stats(void);
+
 /**
  * @brief Enables 3D service
  * @param enable integer
  */
 void pp2d_set_3D(bool enable);
 
+/**
+ * @brief Enables batch merging
+ * @param enable true to record draws and replay each one with the latest earlier draw sharing its texture and kind of primitive, when no draw in between overlaps it
+ * @note Draws sharing state are drawn together even when other draws were submitted between them, while overlapping draws keep their order.
+ * Draws under different clip rects are drawn together too when neither rect cuts them
+ */
+void pp2d_set_batch_merging(bool enable);
+
+/**
+ * @brief Sets the layer of the next draws while draw sorting or the opaque pass is enabled
+ * @param layer higher layers are drawn over lower ones, 0 by default
+ */
+void pp2d_set_draw_layer(u8 layer);
+
+/**
+ * @brief Marks the next sprites and rectangles as opaque while the opaque pass is enabled
+ * @param opaque true when every pixel they cover is fully opaque, false by default
+ * @note Text is never opaque
+ */
+void pp2d_set_draw_opaque(bool opaque);
+
+/**
+ * @brief Enables draw sorting
+ * @param enable true to record draws and replay them sorted by layer, depth, kind of primitive and texture when changing target or ending the frame
+ * @note Overlapping draws only keep their relative order when they differ in layer or depth, or share texture and kind of primitive. Takes precedence over batch merging
+ */
+void pp2d_set_draw_sorting(bool enable);
+
+/**
+ * @brief Enables geometry shader sprites
+ * @param enable true to queue textures as a single point each, rotated and expanded to a quad on the GPU
+ * @note The point buffer is allocated the first time this is enabled
+ */
+void pp2d_set_geometry_sprites(bool enable);
+
+/**
+ * @brief Enables instanced sprites
+ * @param enable true to queue textures as uniforms read by a vertex shader, up to 22 sprites per draw call
+ * @note Geometry shader sprites take precedence, and sprites recorded for sorting, merging or static layers are still queued as quads
+ */
+void pp2d_set_instanced_sprites(bool enable);
+
+/**
+ * @brief Enables the opaque pass
+ * @param enable true to record draws like draw sorting, written at a depth given by their layer, and replay the opaque ones first, from the front layer to the back one, so the depth test rejects the pixels they hide
+ * @note The other draws follow, sorted as with draw sorting. Enable it before drawing on a target, as draws made before would not be at the depth of a layer.
+ * Tile maps and static layers are drawn at the depth of the current layer too
+ */
+void pp2d_set_opaque_pass(bool enable);
+
 /**
  * @brief Sets a background color for the specified screen
  * @param target GFX_TOP or GFX_BOTTOM
@@ -280,6 +600,21 @@ void pp2d_set_3D(bool enable);
  */
 void pp2d_set_screen_color(gfxScreen_t target, u32 color);
 
+/**
+ * @brief Keeps showing the last picture rendered on a screen
+ * @param target GFX_TOP or GFX_BOTTOM
+ * @param unchanged true to skip clearing, drawing and the display transfer of that screen, once the next frame has drawn it in the other framebuffer too
+ * @note Keep drawing the same picture for that frame. Draws to the screen are discarded after it, so they can be skipped. Set it to false before drawing something different
+ */
+void pp2d_set_screen_unchanged(gfxScreen_t target, bool unchanged);
+
+/**
+ * @brief Enables deferred text mode
+ * @param enable true to collect glyphs from the pp2d_draw_text family and draw them later grouped by glyph sheet
+ * @note Deferred text is drawn over everything else rendered on the same target before pp2d_draw_text_deferred
+ */
+void pp2d_set_text_deferred(bool enable);
+
 /**
  * @brief Sets filters to load texture with
  * @param magFilter GPU_NEAREST or GPU_LINEAR
@@ -287,6 +622,45 @@ void pp2d_set_screen_color(gfxScreen_t target, u32 color);
  */
 void pp2d_set_texture_filter(GPU_TEXTURE_FILTER_PARAM magFilter, GPU_TEXTURE_FILTER_PARAM minFilter);
 
+/**
+ * @brief Starts recording a static layer, the following draws are kept in the layer instead of being drawn
+ * @param id of the static layer
+ * @note Draw sorting, batch merging and deferred text are suspended until pp2d_static_layer_end. Don't change target or end the frame while recording.
+ * The clip rect and mask set before are left out of the layer, clip rects and masks set while recording only apply inside it
+ */
+void pp2d_static_layer_begin(size_t id);
+
+/**
+ * @brief Draws a static layer as it was recorded, over everything submitted before, inside the current clip rect and mask
+ * @param id of the static layer
+ */
+void pp2d_static_layer_draw(size_t id);
+
+/**
+ * @brief Stops recording the static layer started by pp2d_static_layer_begin
+ */
+void pp2d_static_layer_end(void);
+
+/**
+ * @brief Frees the memory held by a static layer
+ * @param id of the static layer
+ */
+void pp2d_static_layer_free(size_t id);
+
+/**
+ * @brief Tells whether a static layer needs to be recorded
+ * @param id of the static layer
+ * @return true if the layer was never recorded or was marked dirty since
+ */
+bool pp2d_static_layer_is_dirty(size_t id);
+
+/**
+ * @brief Marks a static layer as dirty, so the next pp2d_static_layer_is_dirty returns true
+ * @param id of the static layer
+ * @note The layer can still be drawn as it was recorded until it is recorded again
+ */
+void pp2d_static_layer_mark_dirty(size_t id);
+
 /**
  * @brief Inits a portion of a texture to be drawn
  * @param id of the texture 
@@ -308,6 +682,7 @@ void pp2d_texture_blend(u32 color);
 /**
  * @brief Sets the depth of a texture
  * @param depth factor of the texture
+ * @note Lower depths are drawn in front of higher ones, and draw sorting draws higher ones first
  */
 void pp2d_texture_depth(float depth);
 
@@ -320,6 +695,29 @@ void pp2d_texture_flip(flipType_t fliptype);
 /// Queues a texture
 void pp2d_texture_queue(void);
 
+/**
+ * @brief Queues many sprites from the same texture in one call
+ * @param id of the texture
+ * @param sprites pointer to the first sprite
+ * @param count number of sprites to queue
+ * @param stride bytes between two consecutive sprites, 0 if they are packed
+ * @note Sprites are drawn at PP2D_DEFAULT_DEPTH, unflipped and unscaled, without changing the pp2d_texture_select state
+ */
+void pp2d_texture_queue_batch(size_t id, const pp2d_sprite_s* sprites, size_t count, size_t stride);
+
+/**
+ * @brief Queues a panel stretched to a rectangle from nine slices of a texture: corners keep their size, edges stretch along them and the center fills the rest
+ * @param id of the texture
+ * @param slice source rectangle of the panel and its border insets
+ * @param x position on the screen of the top left corner
+ * @param y position on the screen of the top left corner
+ * @param width of the panel on the screen
+ * @param height of the panel on the screen
+ * @param color to modulate the texture
+ * @note Borders shrink when the panel is smaller than them, and empty slices are skipped. Like pp2d_texture_queue_batch, the panel is drawn at PP2D_DEFAULT_DEPTH without changing the pp2d_texture_select state
+ */
+void pp2d_texture_queue_nine_slice(size_t id, const pp2d_nine_slice_s* slice, int x, int y, int width, int height, u32 color);
+
 /**
  * @brief Sets the position to draw the texture to
  * @param x position
@@ -340,6 +738,58 @@ void pp2d_texture_rotate(float angle);
  */
 void pp2d_texture_scale(float scaleX, float scaleY);
 
+/**
+ * @brief Creates an empty tile map, replacing the one with the same id
+ * @param id of the tile map
+ * @param texture id of the texture holding the tiles
+ * @param columns of tiles in the map
+ * @param rows of tiles in the map
+ * @param tileWidth in pixels, both on the screen and in the texture
+ * @param tileHeight in pixels, both on the screen and in the texture
+ * @note With PP2D_COMPACT_VERTICES chunks are made of fewer tiles when PP2D_TILEMAP_CHUNK tiles would be wider or taller than PP2D_COMPACT_POSITION_RANGE,
+ * and tiles bigger than that are rejected
+ */
+void pp2d_tilemap_create(size_t id, size_t texture, int columns, int rows, int tileWidth, int tileHeight);
+
+/**
+ * @brief Draws the part of a tile map seen from a camera, over everything submitted before
+ * @param id of the tile map
+ * @param cameraX position in the map of the pixel drawn at the left edge of the target
+ * @param cameraY position in the map of the pixel drawn at the top edge of the target
+ * @note Chunks whose tiles changed are written again first, in memory the draws already made don't read, so tiles changed after a map is drawn show the next time it's drawn
+ */
+void pp2d_tilemap_draw(size_t id, int cameraX, int cameraY);
+
+/**
+ * @brief Frees the memory held by a tile map
+ * @param id of the tile map
+ */
+void pp2d_tilemap_free(size_t id);
+
+/**
+ * @brief Returns a tile of a tile map, 0 outside the map
+ * @param id of the tile map
+ * @param column of the tile
+ * @param row of the tile
+ */
+u16 pp2d_tilemap_get_tile(size_t id, int column, int row);
+
+/**
+ * @brief Changes a tile of a tile map
+ * @param id of the tile map
+ * @param column of the tile
+ * @param row of the tile
+ * @param tile 0 to leave it empty, otherwise the number of the tile in the texture, from 1, left to right then top to bottom
+ */
+void pp2d_tilemap_set_tile(size_t id, int column, int row, u16 tile);
+
+/**
+ * @brief Changes all the tiles of a tile map
+ * @param id of the tile map
+ * @param tiles row after row, numbered as in pp2d_tilemap_set_tile, the map is left unchanged when NULL
+ */
+void pp2d_tilemap_set_tiles(size_t id, const u16* tiles);
+
 #ifdef __cplusplus
 }
 #endif